@@ -3,6 +3,7 @@ ORIGIN_WORK_DIR="$PWD"
 
 KERNEL_DDRIVER="./kernel_ddriver"
 KERNEL_DEV_PATH="/dev/ddriver"
+KERNEL_CAPACITY_PATH="/sys/module/ddriver/parameters/capacity_mb"
 
 USER_DDRIVER="./user_ddriver"
 USER_LOG_PATH="$HOME/ddriver_log"
@@ -19,7 +20,7 @@ fi
 cd "$WORK_DIR" || exit
 
 CONFIG_BLOCK_SZ=512
-BLOCK_COUNT=8192
+BLOCK_COUNT=8192                    # 无法获知设备大小时的默认值(4MB)
 
 
 function usage(){
@@ -39,6 +40,7 @@ function usage(){
     echo "-d            导出ddriver至当前工作目录[PWD]"
     echo "-r            擦除ddriver"
     echo "-l            显示ddriver的Log"
+    echo "-s            实时显示已打开ddriver的IOPS、带宽与寻道频率[仅用户态]"
     echo "-v            显示ddriver的类型[内核模块 / 用户静态链接库]"
     echo "-h            打印本帮助菜单"
     echo "===================================================================="
@@ -80,7 +82,7 @@ function install() {
         sudo rm $KERNEL_DEV_PATH>/dev/null 2>&1 
         sudo rmmod ddriver>/dev/null 2>&1 
         sudo dmesg -C
-        sudo insmod ./ddriver.ko
+        sudo insmod ./ddriver.ko ${DDRIVER_CAPACITY_MB:+capacity_mb=$DDRIVER_CAPACITY_MB}
         in=$(dmesg | tail -n 1)
         tokens=("$in")
         major_number=${tokens[${#tokens[*]}-1]}
@@ -101,6 +103,7 @@ function install() {
         LAST_DIR=$PWD
         cd $USER_DDRIVER || exit
         make all -f ./Makefile
+        make stat -f ./Makefile
         
         mkdir -p bin
         
@@ -120,14 +123,33 @@ function install() {
     fi
 }
 
+# 设备的块数: 内核设备取模块参数capacity_mb, 用户态设备取镜像文件大小
+function block_count() {
+    local size=""
+    if [ "$DDRIVER_TYPE" == "k" ]; then
+        if [ -r "$KERNEL_CAPACITY_PATH" ]; then
+            size=$(( $(cat "$KERNEL_CAPACITY_PATH") * 1024 * 1024 ))
+        fi
+    elif [ -f "$USER_DEV_PATH" ]; then
+        size=$(stat -c %s "$USER_DEV_PATH")
+    fi
+    if [ -n "$size" ] && [ "$size" -gt 0 ]; then
+        echo $(( size / CONFIG_BLOCK_SZ ))
+    else
+        echo $BLOCK_COUNT
+    fi
+}
+
 function test(){
+    local count
+    count=$(block_count)
     if [ "$DDRIVER_TYPE" == "k" ]; then   
         # test read
-        sudo dd if=$KERNEL_DEV_PATH of=read1 bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        sudo dd if=$KERNEL_DEV_PATH of=read1 bs=$CONFIG_BLOCK_SZ count=$count
         # test write
         sudo dd if=/dev/random of=$KERNEL_DEV_PATH bs=$CONFIG_BLOCK_SZ count=2
         # test read
-        sudo dd if=$KERNEL_DEV_PATH of=read2 bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        sudo dd if=$KERNEL_DEV_PATH of=read2 bs=$CONFIG_BLOCK_SZ count=$count
     else 
         exit
     fi
@@ -141,25 +163,41 @@ function log() {
     fi
 }
 
+function live_stat() {
+    if [ "$DDRIVER_TYPE" == "k" ]; then  
+        echo "内核设备暂不支持实时统计"
+        exit 1
+    fi
+    if [ ! -x "$USER_DDRIVER"/ddriver_stat ]; then
+        make stat -C "$USER_DDRIVER" >/dev/null || exit
+    fi
+    "$USER_DDRIVER"/ddriver_stat "$USER_DEV_PATH"
+}
+
 function dump(){
+    local count
+    count=$(block_count)
     sudo rm "$ORIGIN_WORK_DIR"/ddriver_dump>/dev/null 2>&1 
     if [ "$DDRIVER_TYPE" == "k" ]; then  
         echo "目标设备 $KERNEL_DEV_PATH"
-        sudo dd if=$KERNEL_DEV_PATH of="$ORIGIN_WORK_DIR"/ddriver_dump bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        sudo dd if=$KERNEL_DEV_PATH of="$ORIGIN_WORK_DIR"/ddriver_dump bs=$CONFIG_BLOCK_SZ count=$count
     else 
         echo "目标设备 $USER_DEV_PATH"
-        dd if="$USER_DEV_PATH" of="$ORIGIN_WORK_DIR"/ddriver_dump bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        dd if="$USER_DEV_PATH" of="$ORIGIN_WORK_DIR"/ddriver_dump bs=$CONFIG_BLOCK_SZ count=$count conv=sparse
     fi
     echo "文件已导出至$ORIGIN_WORK_DIR/ddriver_dump，请安装HexEditor插件查看其内容"
 }
 
 function clean(){
+    local count
+    count=$(block_count)
     if [ "$DDRIVER_TYPE" == "k" ]; then  
         echo "目标设备 $KERNEL_DEV_PATH"
-        sudo dd if=/dev/zero of=$KERNEL_DEV_PATH bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        sudo dd if=/dev/zero of=$KERNEL_DEV_PATH bs=$CONFIG_BLOCK_SZ count=$count
     else
         echo "目标设备 $USER_DEV_PATH"
-        dd if=/dev/zero of="$USER_DEV_PATH" bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        # 截断后恢复原大小, 整个镜像读回为0且仍是稀疏文件
+        truncate -s 0 "$USER_DEV_PATH" && truncate -s $(( count * CONFIG_BLOCK_SZ )) "$USER_DEV_PATH"
     fi 
 }
 
@@ -174,7 +212,7 @@ function version () {
 if [ $# == 0 ]; then
     usage
 else 
-    while getopts 'i:tdhrlv' OPT; do
+    while getopts 'i:tdhrlsv' OPT; do
         case $OPT in
             i) install "$OPTARG"
             ;;
@@ -186,6 +224,8 @@ else
             ;;
             l) log
             ;;
+            s) live_stat
+            ;;
             v) version 
             ;;
             h) usage
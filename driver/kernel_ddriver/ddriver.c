@@ -2,6 +2,14 @@
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/xarray.h>
+#include <linux/highmem.h>
+#include <linux/pfn_t.h>
+#include <linux/uio.h>
+#include <linux/rwsem.h>
+#include <linux/atomic.h>
 #include <asm/uaccess.h>
 #include <linux/uaccess.h>
 #include "ddriver_ctl.h"
@@ -27,8 +35,9 @@
                         "filp_open/cpp-filp_open-function-examples.html>"
 #define DRIVER_VERSION  "0.1.0"
 
-#define CONFIG_DISK_SZ  (4 * 1024 * 1024)
+#define CONFIG_DISK_MB  (4)                               /* Default of capacity_mb */
 #define CONFIG_BLOCK_SZ (512)
+#define CONFIG_BATCH_MAX (1024)                           /* Descriptors per IOC_REQ_SUBMIT_BATCH */
 /******************************************************************************
 * SECTION: Macro Functions 
 *******************************************************************************/
@@ -36,14 +45,11 @@
 #define IS_ADDR_ALIGN(addr)     (addr % CONFIG_BLOCK_SZ == 0)
 #define ADDR_ROUND_UP(addr)     ((addr / CONFIG_BLOCK_SZ) * CONFIG_BLOCK_SZ)
 
-#define GET_HEAD_POS(disk)      (disk.head - disk.layout)
-#define FORWARD_HEAD(disk, dis) (disk.head += dis)
-#define SET_HEAD(disk, ofs)     (disk.head = disk.layout + ofs)
-#define RESET_HEAD(disk)        (SET_HEAD(disk, 0))
+#define GET_HEAD_POS(file)      ((file)->f_pos)       /* Every opener has its own head */
 
-#define INC_READCNT(disk)       (disk.read_cnt++)
-#define INC_WRITECNT(disk)      (disk.write_cnt++)
-#define INC_SEEKCNT(disk)       (disk.seek_cnt++)
+#define INC_READCNT(disk)       (atomic_inc(&disk.read_cnt))
+#define INC_WRITECNT(disk)      (atomic_inc(&disk.write_cnt))
+#define INC_SEEKCNT(disk)       (atomic_inc(&disk.seek_cnt))
 /******************************************************************************
 * SECTION: Kernel Module Template
 *******************************************************************************/
@@ -51,63 +57,185 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR(DRIVER_AUTHOR);	    
 MODULE_DESCRIPTION(DRIVER_DESC);	
 MODULE_VERSION(DRIVER_VERSION);	
+
+static unsigned long capacity_mb = CONFIG_DISK_MB;
+module_param(capacity_mb, ulong, 0444);
+MODULE_PARM_DESC(capacity_mb, "Device capacity in MB, pages are allocated on first write");
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
 struct ddriver
 {
-    char layout[CONFIG_DISK_SZ];                      /* Disk Layout */
-    char *head;                                       /* Disk Head */
-    int  read_cnt;
-    int  write_cnt;
-    int  seek_cnt;
+    struct xarray pages;                              /* Disk Layout, by page index,
+                                                         absent pages read as zero */
+    struct rw_semaphore lock;                         /* Shared by page lookups, exclusive
+                                                         for anything that frees pages */
+    atomic_t read_cnt;
+    atomic_t write_cnt;
+    atomic_t seek_cnt;
     int  major_num;
-    int  open_count;
-    int  layout_size;
+    atomic_t open_count;
+    long long layout_size;
     int  iounit_size;
 };
 
 static struct ddriver disk = {
-    .head        = NULL,
-    .read_cnt    = 0,
-    .write_cnt   = 0,
-    .seek_cnt    = 0,
+    .read_cnt    = ATOMIC_INIT(0),
+    .write_cnt   = ATOMIC_INIT(0),
+    .seek_cnt    = ATOMIC_INIT(0),
     .major_num   = 0,
-    .open_count  = 0,
-    .layout_size = CONFIG_DISK_SZ,
+    .open_count  = ATOMIC_INIT(0),
+    .layout_size = (long long)CONFIG_DISK_MB << 20,
     .iounit_size = CONFIG_BLOCK_SZ
 };
 /******************************************************************************
 * SECTION: Helper Functions
 *******************************************************************************/
-int check_valid(size_t size){
-    if (GET_HEAD_POS(disk) >=  CONFIG_DISK_SZ) {
+int check_valid(loff_t pos, size_t size){
+    if (pos < 0 || pos >= disk.layout_size) {
         kernel_alert("disk head reach the end");
         return -EINVAL;
     }
-    if (size != CONFIG_BLOCK_SZ){
+    if (!IS_ADDR_ALIGN(pos)) {
+        kernel_alert("offset %lld must be aligned to block size %d", pos, CONFIG_BLOCK_SZ);
+        return -EINVAL;
+    }
+    if (size == 0 || !IS_ADDR_ALIGN(size)){           /* Any number of sectors in one call */
         kernel_alert("io size %ld should align to %d", size, CONFIG_BLOCK_SZ);
         return -EIO;
     }
+    if (size > disk.layout_size - pos) {
+        kernel_alert("io [%lld, %lld) out of device range %lld", 
+                     pos, pos + size, disk.layout_size);
+        return -EIO;
+    }
+    return 0;
+}
+
+static struct page* disk_lookup_page(loff_t pos) {
+    return xa_load(&disk.pages, pos >> PAGE_SHIFT);
+}
+
+static struct page* disk_insert_page(struct address_space *mapping, loff_t pos) {
+    struct page *page, *cur;
+
+    page = disk_lookup_page(pos);
+    if (page)
+        return page;
+    page = alloc_page(GFP_KERNEL | __GFP_ZERO | __GFP_HIGHMEM);
+    if (!page)
+        return NULL;
+    cur = xa_cmpxchg(&disk.pages, pos >> PAGE_SHIFT, NULL, page, GFP_KERNEL);
+    if (cur) {                                        /* Lost a race, or no memory for the node */
+        __free_page(page);
+        return xa_is_err(cur) ? NULL : cur;
+    }
+    unmap_mapping_range(mapping, pos & PAGE_MASK, PAGE_SIZE, 0);
+    return page;                                      /* Hole readers refault off the zero page */
+}
+
+static struct page* disk_get_page(struct address_space *mapping, loff_t pos, bool create) {
+    struct page *page;
+                                                      /* The lock is never held across user
+                                                         copies, they may fault on a mapping
+                                                         of this device */
+    down_read(&disk.lock);
+    page = create ? disk_insert_page(mapping, pos) : disk_lookup_page(pos);
+    if (page)
+        get_page(page);                               /* Outlives a racing DISCARD or RESET */
+    up_read(&disk.lock);
+    return page;
+}
+
+static int disk_copy_to_iter(struct iov_iter *to, loff_t pos, size_t len) {
+    struct page *page;
+    size_t done, n, copied;
+
+    for (done = 0; done < len; done += n) {
+        n = min_t(size_t, len - done, PAGE_SIZE - offset_in_page(pos + done));
+        page = disk_get_page(NULL, pos + done, false);
+        if (!page) {                                  /* Never written */
+            copied = iov_iter_zero(n, to);
+        }
+        else {
+            copied = copy_page_to_iter(page, offset_in_page(pos + done), n, to);
+            put_page(page);
+        }
+        if (copied != n)
+            return -EFAULT;
+        cond_resched();                               /* Large transfers span many pages */
+    }
+    return 0;
+}
+
+static int disk_copy_from_iter(struct address_space *mapping, loff_t pos, 
+                               struct iov_iter *from, size_t len) {
+    struct page *page;
+    size_t done, n, copied;
+
+    for (done = 0; done < len; done += n) {
+        n = min_t(size_t, len - done, PAGE_SIZE - offset_in_page(pos + done));
+        page = disk_get_page(mapping, pos + done, true);
+        if (!page)
+            return -ENOMEM;
+        copied = copy_page_from_iter(page, offset_in_page(pos + done), n, from);
+        put_page(page);
+        if (copied != n)
+            return -EFAULT;
+        cond_resched();
+    }
     return 0;
 }
+
+static void disk_discard(loff_t pos, loff_t len) {
+    struct page *page;
+    loff_t end = pos + len;
+    size_t n;
+
+    for (; pos < end; pos += n) {
+        n = min_t(loff_t, end - pos, PAGE_SIZE - offset_in_page(pos));
+        if (n == PAGE_SIZE) {                         /* Whole page, give it back */
+            page = xa_erase(&disk.pages, pos >> PAGE_SHIFT);
+            if (page)
+                put_page(page);                       /* Freed once in-flight copies finish */
+        }
+        else {
+            page = disk_lookup_page(pos);
+            if (page)
+                zero_user(page, offset_in_page(pos), n);
+        }
+    }
+}
+
+static void disk_free_pages(void) {
+    struct page *page;
+    unsigned long idx;
+
+    xa_for_each(&disk.pages, idx, page) {
+        xa_erase(&disk.pages, idx);
+        put_page(page);
+        cond_resched();
+    }
+}
 /******************************************************************************
 * SECTION: Function definitions
 *******************************************************************************/
 static int      device_open(struct inode *, struct file *);
 static int      device_release(struct inode *, struct file *);
-static ssize_t  device_read(struct file *, char *, size_t, loff_t *);
-static ssize_t  device_write(struct file *, const char *, size_t, loff_t *);
+static ssize_t  device_read_iter(struct kiocb *, struct iov_iter *);
+static ssize_t  device_write_iter(struct kiocb *, struct iov_iter *);
 static loff_t   device_seek(struct file *, loff_t, int);
+static int      device_mmap(struct file *, struct vm_area_struct *);
 static long     device_ioctl(struct file *, unsigned int, unsigned long);
 /******************************************************************************
 * SECTION: Global var or structure definitions
 *******************************************************************************/
 static struct file_operations file_ops = {
-    .read = device_read,
-    .write = device_write,
+    .read_iter = device_read_iter,
+    .write_iter = device_write_iter,
     .open = device_open,
     .llseek = device_seek,
+    .mmap = device_mmap,
     .unlocked_ioctl = device_ioctl,
     .release = device_release
 };
@@ -115,61 +243,56 @@ static struct file_operations file_ops = {
 * SECTION: Function Implementation
 *******************************************************************************/
 /**
- * @brief Disk Read
+ * @brief Disk Read, at the file offset for read(2) or the given one for pread(2)
  * 
- * @param file          Ignored
- * @param user_buffer   User space buffer
- * @param size          Must equal to Blocksize @CONFIG_BLOCK_SZ
- * @param offset        Ignored
+ * @param iocb          Carries the offset, advanced on success
+ * @param to            User space buffers, a multiple of @CONFIG_BLOCK_SZ
  * @return ssize_t      Bytes have been read 
  */
 static ssize_t 
-device_read(struct file *file, char *user_buffer, size_t size, loff_t *offset) {
-    IGNORE_ARG(offset);
-    IGNORE_ARG(file);
-    int res = check_valid(size);
+device_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    size_t size = iov_iter_count(to);
+    int res = check_valid(iocb->ki_pos, size);
     if(res < 0)
         return res;
-    if (copy_to_user(user_buffer, disk.head, CONFIG_BLOCK_SZ))
-        return -EFAULT;
-    FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
+    res = disk_copy_to_iter(to, iocb->ki_pos, size);
+    if (res < 0)
+        return res;
+    iocb->ki_pos += size;
     INC_READCNT(disk);
-    return CONFIG_BLOCK_SZ;
+    return size;
 }
 /**
- * @brief Disk Write
+ * @brief Disk Write, at the file offset for write(2) or the given one for pwrite(2)
  * 
- * @param file          Ignored
- * @param user_buffer   User space buffer, copy content from
- * @param size          Must equal to Blocksize @CONFIG_BLOCK_SZ
- * @param offset        Ignored
+ * @param iocb          Carries the offset, advanced on success
+ * @param from          User space buffers, a multiple of @CONFIG_BLOCK_SZ
  * @return ssize_t      Bytes have been written
  */
 static ssize_t 
-device_write(struct file *file, const char *user_buffer, size_t size, loff_t *offset) {
-    IGNORE_ARG(offset);
-    IGNORE_ARG(file);
-    int res = check_valid(size);
+device_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    size_t size = iov_iter_count(from);
+    int res = check_valid(iocb->ki_pos, size);
     if(res < 0)
         return res;
-
-    if (copy_from_user(disk.head, user_buffer, CONFIG_BLOCK_SZ))
-        return -EFAULT;
-    FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
+    res = disk_copy_from_iter(iocb->ki_filp->f_mapping, iocb->ki_pos, from, size);
+    if (res < 0)
+        return res;
+    iocb->ki_pos += size;
     INC_WRITECNT(disk);
-    return CONFIG_BLOCK_SZ;
+    return size;
 }
 /**
  * @brief Disk Seek
  * 
- * @param file          Ignored
+ * @param file          Moves this opener's head only
  * @param offset        Aligned to @CONFIG_BLOCK_SZ
- * @param whence        SEEK_CUR, SEEK_SET
+ * @param whence        SEEK_SET, SEEK_CUR, SEEK_END
  * @return loff_t       cur pos
  */
 static loff_t 
 device_seek(struct file *file, loff_t offset, int whence) {
-    IGNORE_ARG(file);
+    loff_t pos;
     if (!IS_ADDR_ALIGN(offset)) {
         kernel_alert("offset %lld must be aligned to block size %d", 
                       offset, CONFIG_BLOCK_SZ);
@@ -178,56 +301,222 @@ device_seek(struct file *file, loff_t offset, int whence) {
     switch (whence)
     {
     case SEEK_SET:
-        SET_HEAD(disk, offset);
+        pos = offset;
         break;
     case SEEK_CUR:
-        FORWARD_HEAD(disk, offset);
+        pos = GET_HEAD_POS(file) + offset;
         break;
-    default:
+    case SEEK_END:
+        pos = disk.layout_size + offset;
         break;
+    default:
+        return -EINVAL;
     }
-    INC_SEEKCNT(disk);
-    return GET_HEAD_POS(disk);
+    pos = vfs_setpos(file, pos, disk.layout_size);
+    if (pos >= 0)
+        INC_SEEKCNT(disk);
+    return pos;
 }
 /**
- * @brief Disk ioctl
+ * @brief Disk Page Fault, maps the backing page itself, or the zero page for a hole
+ * 
+ * @param vmf           Faulting page of the mapping
+ * @return vm_fault_t   0 with @vmf->page held, or VM_FAULT_*
+ */
+static vm_fault_t 
+device_fault(struct vm_fault *vmf) {
+    struct address_space *mapping = vmf->vma->vm_file->f_mapping;
+    loff_t pos = (loff_t)vmf->pgoff << PAGE_SHIFT;
+    bool write = (vmf->flags & FAULT_FLAG_WRITE) && (vmf->vma->vm_flags & VM_SHARED);
+    struct page *page;
+    vm_fault_t ret;
+
+    if (pos >= disk.layout_size)
+        return VM_FAULT_SIGBUS;
+    page = disk_get_page(mapping, pos, write);        /* Only stores allocate, the reference
+                                                         is dropped when unmapped */
+    if (page) {
+        vmf->page = page;
+        return 0;
+    }
+    if (write)
+        return VM_FAULT_OOM;
+                                                      /* Read only until device_pfn_mkwrite */
+    ret = vmf_insert_mixed(vmf->vma, vmf->address, pfn_to_pfn_t(my_zero_pfn(vmf->address)));
+    if (disk_lookup_page(pos))                        /* Written meanwhile, refault onto it */
+        unmap_mapping_range(mapping, pos, PAGE_SIZE, 0);
+    return ret;
+}
+/**
+ * @brief Disk Write Fault on the zero page, backs the hole with a page of its own
+ * 
+ * @param vmf           Faulting page of the mapping
+ * @return vm_fault_t   VM_FAULT_NOPAGE to refault onto the new page, or VM_FAULT_OOM
+ */
+static vm_fault_t 
+device_pfn_mkwrite(struct vm_fault *vmf) {
+    struct address_space *mapping = vmf->vma->vm_file->f_mapping;
+    loff_t pos = (loff_t)vmf->pgoff << PAGE_SHIFT;
+    struct page *page = disk_get_page(mapping, pos, true);
+
+    if (!page)
+        return VM_FAULT_OOM;
+    put_page(page);
+    unmap_mapping_range(mapping, pos, PAGE_SIZE, 0);  /* Even if another writer inserted it */
+    return VM_FAULT_NOPAGE;
+}
+
+static const struct vm_operations_struct device_vm_ops = {
+    .fault = device_fault,
+    .pfn_mkwrite = device_pfn_mkwrite                 /* Also keeps the zero page read only */
+};
+/**
+ * @brief Disk mmap, loads and stores skip copy_to_user and copy_from_user
  * 
  * @param file          Ignored
+ * @param vma           Must lie within the device
+ * @return int          state
+ */
+static int 
+device_mmap(struct file *file, struct vm_area_struct *vma) {
+    loff_t pos = (loff_t)vma->vm_pgoff << PAGE_SHIFT;
+    IGNORE_ARG(file);
+    if (pos >= disk.layout_size 
+        || vma->vm_end - vma->vm_start > disk.layout_size - pos) {
+        kernel_alert("mmap [%lld, %lld) out of device range %lld", 
+                     pos, pos + (vma->vm_end - vma->vm_start), disk.layout_size);
+        return -EINVAL;
+    }
+    vma->vm_flags |= VM_MIXEDMAP | VM_DONTEXPAND;     /* Zero page for holes, and no mremap
+                                                         past the range checked above */
+    vma->vm_ops = &device_vm_ops;
+    return 0;
+}
+/**
+ * @brief Disk Batch, every descriptor in one kernel entry
+ * 
+ * @param file          Its hole mappings are dropped by writes
+ * @param ubatch        User space struct ddriver_batch, @done is written back
+ * @return long         0 once all descriptors have their status, or -EFAULT / -EINVAL
+ */
+static long 
+device_submit_batch(struct file *file, struct ddriver_batch __user *ubatch) {
+    struct ddriver_batch batch;
+    struct ddriver_batch_desc desc;
+    struct ddriver_batch_desc __user *udescs;
+    struct iovec iov;
+    struct iov_iter iter;
+    int i, ret;
+
+    if (copy_from_user(&batch, ubatch, sizeof(struct ddriver_batch)))
+        return -EFAULT;
+    if (batch.nr < 0 || batch.nr > CONFIG_BATCH_MAX) {
+        kernel_alert("batch of %d descriptors, at most %d", batch.nr, CONFIG_BATCH_MAX);
+        return -EINVAL;
+    }
+    udescs = u64_to_user_ptr(batch.descs);
+    batch.done = 0;
+    for (i = 0; i < batch.nr; i++) {
+        if (copy_from_user(&desc, &udescs[i], sizeof(struct ddriver_batch_desc)))
+            return -EFAULT;
+        ret = desc.len > INT_MAX ? -EINVAL : check_valid(desc.offset, desc.len);
+        iov.iov_base = u64_to_user_ptr(desc.buf);     /* Copies check access_ok themselves */
+        iov.iov_len  = desc.len;
+        if (ret == 0 && desc.op == DDRIVER_BATCH_READ) {
+            iov_iter_init(&iter, READ, &iov, 1, desc.len);
+            ret = disk_copy_to_iter(&iter, desc.offset, desc.len);
+            if (ret == 0)
+                INC_READCNT(disk);
+        }
+        else if (ret == 0 && desc.op == DDRIVER_BATCH_WRITE) {
+            iov_iter_init(&iter, WRITE, &iov, 1, desc.len);
+            ret = disk_copy_from_iter(file->f_mapping, desc.offset, &iter, desc.len);
+            if (ret == 0)
+                INC_WRITECNT(disk);
+        }
+        else if (ret == 0) {
+            ret = -EINVAL;
+        }
+        desc.status = ret < 0 ? ret : desc.len;       /* Failures don't stop the batch */
+        if (ret == 0)
+            batch.done++;
+        if (put_user(desc.status, &udescs[i].status))
+            return -EFAULT;
+    }
+    if (put_user(batch.done, &ubatch->done))
+        return -EFAULT;
+    return 0;
+}
+/**
+ * @brief Disk ioctl
+ * 
+ * @param file          Its mappings are zapped by DISCARD and RESET
  * @param cmd           Command
  * @param arg           Args
  * @return long         State
  */
 static long 
 device_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
-    IGNORE_ARG(file);
-    int ret;
+    int ret, size;
     struct ddriver_state state;
+    struct ddriver_range range;
     switch (cmd)
     {
-    case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
-        ret = copy_to_user((int __user *)arg, &disk.layout_size, sizeof(int));
+    case IOC_REQ_DEVICE_SIZE:                         /* Device Size, clamped for old callers */
+        size = disk.layout_size > INT_MAX ? ADDR_ROUND_UP(INT_MAX) : disk.layout_size;
+        ret = copy_to_user((int __user *)arg, &size, sizeof(int));
+        if (ret) 
+            return -EFAULT;
+        break;
+    case IOC_REQ_DEVICE_SIZE64:
+        ret = copy_to_user((long long __user *)arg, &disk.layout_size, sizeof(long long));
         if (ret) 
             return -EFAULT;
         break;
     case IOC_REQ_DEVICE_STATE:                        /* Device State */
-        state.read_cnt = disk.read_cnt;
-        state.write_cnt = disk.write_cnt;
-        state.seek_cnt = disk.seek_cnt;
+        state.read_cnt = atomic_read(&disk.read_cnt);
+        state.write_cnt = atomic_read(&disk.write_cnt);
+        state.seek_cnt = atomic_read(&disk.seek_cnt);
         ret = copy_to_user((int __user *)arg, &state, sizeof(struct ddriver_state));
         if (ret) 
             return -EFAULT;
         break;
-    case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
-        disk.head = disk.layout;
-        disk.read_cnt = 0;
-        disk.write_cnt = 0;
-        disk.seek_cnt = 0;
+    case IOC_REQ_DEVICE_RESET:                        /* Reset Device, drops all pages */
+        down_write(&disk.lock);
+        unmap_mapping_range(file->f_mapping, 0, 0, 1);
+        disk_free_pages();
+        up_write(&disk.lock);
+        atomic_set(&disk.read_cnt, 0);
+        atomic_set(&disk.write_cnt, 0);
+        atomic_set(&disk.seek_cnt, 0);
         break;
     case IOC_REQ_DEVICE_IO_SZ:
         ret = copy_to_user((int __user *)arg, &disk.iounit_size, sizeof(int));
         if (ret) 
             return -EFAULT;
         break;
+    case IOC_REQ_DEVICE_FLUSH:                        /* The pages are the medium, nothing
+                                                         to write back */
+        smp_mb();                                     /* Order stores made through mmap */
+        break;
+    case IOC_REQ_SUBMIT_BATCH:                        /* Many reads and writes, one syscall */
+        return device_submit_batch(file, (struct ddriver_batch __user *)arg);
+    case IOC_REQ_DEVICE_DISCARD:                      /* Drop a range, reads back as zero */
+        ret = copy_from_user(&range, (struct ddriver_range __user *)arg, 
+                             sizeof(struct ddriver_range));
+        if (ret) 
+            return -EFAULT;
+        if (!IS_ADDR_ALIGN(range.offset) || !IS_ADDR_ALIGN(range.len) || range.offset < 0 
+            || range.len <= 0 || range.offset + range.len > disk.layout_size) {
+            kernel_alert("discard [%lld, %lld) out of device range %lld", 
+                         range.offset, range.offset + range.len, disk.layout_size);
+            return -EINVAL;
+        }
+        down_write(&disk.lock);                       /* Mappings refault to the new pages */
+        unmap_mapping_range(file->f_mapping, range.offset, range.len, 1);
+        disk_discard(range.offset, range.len);
+        up_write(&disk.lock);
+        break;
     default:
         break;
     }
@@ -244,12 +533,9 @@ static int
 device_open(struct inode *inode, struct file *file) {
     IGNORE_ARG(inode);
     IGNORE_ARG(file);
-    
-    if (disk.open_count) {                            /* If device is open, return busy */
-        return -EBUSY;
-    }
-    RESET_HEAD(disk);                                 /* Everytime close device, reset head */
-    disk.open_count++;
+                                                      /* Shared by any number of openers,
+                                                         each head starts at 0 */
+    atomic_inc(&disk.open_count);
     try_module_get(THIS_MODULE);
     return 0;
 }
@@ -266,7 +552,7 @@ device_release(struct inode *inode, struct file *file) {
                                                          Without this, the module would not unload. */
     IGNORE_ARG(inode);
     IGNORE_ARG(file);
-    disk.open_count--;
+    atomic_dec(&disk.open_count);
     module_put(THIS_MODULE);
     return 0;
 }
@@ -276,16 +562,25 @@ device_release(struct inode *inode, struct file *file) {
 static int __init 
 ddriver_init(void)
 {
-    int major_num = register_chrdev(0, DEVICE_NAME, &file_ops);   
+    int major_num;
+
+    if (capacity_mb == 0) {
+        kernel_alert("capacity_mb must be positive");
+        return -EINVAL;
+    }
+    disk.layout_size = (long long)capacity_mb << 20;
+    xa_init(&disk.pages);
+    init_rwsem(&disk.lock);
+    major_num = register_chrdev(0, DEVICE_NAME, &file_ops);   
                                                       /* Register an device */
     if (major_num < 0) {                              /* Register fail */
         kernel_alert("Can't register device, ret %d", major_num);
         return major_num;
     } 
     else {                                            /* Register success */                                                  
+        kernel_info("capacity %lu MB", capacity_mb);
         kernel_info("module loaded with device major number %d", major_num);
         disk.major_num = major_num;
-        memset(disk.layout, 0, CONFIG_DISK_SZ);
         return 0;
     }
     return 0;
@@ -299,6 +594,8 @@ ddriver_exit(void)
     if(major_num != 0){
         unregister_chrdev(major_num, DEVICE_NAME);
     }
+    disk_free_pages();
+    xa_destroy(&disk.pages);
 }
 
 module_init(ddriver_init);
@@ -13,9 +13,38 @@ struct ddriver_state
     int seek_cnt;
 };
 
+struct ddriver_range
+{
+    long long offset;                               /* Aligned to IO unit */
+    long long len;                                  /* Multiple of IO unit */
+};
+
+#define DDRIVER_BATCH_READ      0                   /* Same values as DDRIVER_OP_* */
+#define DDRIVER_BATCH_WRITE     1
+
+struct ddriver_batch_desc
+{
+    int op;                                         /* DDRIVER_BATCH_* */
+    int status;                                     /* Out: bytes transferred, or -errno */
+    long long offset;                               /* Aligned to IO unit */
+    long long len;                                  /* Multiple of IO unit */
+    unsigned long long buf;                         /* User buffer address */
+};
+
+struct ddriver_batch
+{
+    int nr;                                         /* Descriptors at @descs */
+    int done;                                       /* Out: descriptors that succeeded */
+    unsigned long long descs;                       /* Address of struct ddriver_batch_desc[nr] */
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_FLUSH    _IO(IOC_MAGIC, 4)
+#define IOC_REQ_DEVICE_SIZE64   _IOR(IOC_MAGIC, 13, long long)
+#define IOC_REQ_DEVICE_DISCARD  _IOW(IOC_MAGIC, 14, struct ddriver_range)
+#define IOC_REQ_SUBMIT_BATCH    _IOWR(IOC_MAGIC, 15, struct ddriver_batch)
 
 #endif
\ No newline at end of file
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE                                   /* fallocate */
 #include "stdio.h"
 #include "stdlib.h"
 #include <unistd.h>
@@ -5,11 +6,18 @@
 #include <fcntl.h>
 #include "string.h"
 #include <linux/fs.h>
+#include <sys/uio.h>
 #include "ddriver_ctl.h"
+#include "include/ddriver.h"
 #include "stdio.h"
 #include "errno.h"
 #include <pwd.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <math.h>
+#include <limits.h>
+#include <stdint.h>
 
 extern int errno;
 
@@ -21,18 +29,22 @@ extern int errno;
 * SECTION: Macro definitions
 *******************************************************************************/   
 #define DEVICE_NAME   "ddriver"
-#define DEVICE_LOG    "ddriver_log"
+#define DEVICE_LOG    "_log"                         /* Appended to the image path */
+#define DEVICE_COW    "_cow"                         /* Block map of an overlay image */
+#define DEVICE_STATS  "_stats"                       /* Live counters, see ddriver_stat */
 
-#define user_info(fmt, ...)\
+#define user_info(dev, fmt, ...)\
 	do {\
 		printf(USER_INFO DEVICE_NAME " " fmt "\n", ##__VA_ARGS__);\
-        fprintf(debugf, USER_PANIC  " " fmt "\n", ##__VA_ARGS__);\
+        if ((dev)->log != NULL)\
+            fprintf((dev)->log, USER_PANIC  " " fmt "\n", ##__VA_ARGS__);\
 	} while(0)\
 
-#define user_alert(fmt, ...)\
+#define user_alert(dev, fmt, ...)\
 	do {\
 		printf(USER_ALERT DEVICE_NAME " " fmt "\n", ##__VA_ARGS__);\
-        fprintf(debugf, USER_PANIC  " " fmt "\n", ##__VA_ARGS__);\
+        if ((dev)->log != NULL)\
+            fprintf((dev)->log, USER_PANIC  " " fmt "\n", ##__VA_ARGS__);\
 	} while(0)\
 
 #define user_panic(fmt, ...)\
@@ -44,123 +56,1871 @@ extern int errno;
 #define DRIVER_DESC     "A Fake disk driver in user space"
 #define DRIVER_VERSION  "0.1.0"
 
-#define CONFIG_DISK_SZ  (4 * 1024 * 1024)
-#define CONFIG_BLOCK_SZ (512)
+#define CONFIG_DISK_SZ   (4 * 1024 * 1024)           /* Defaults, overridable at open */
+#define CONFIG_BLOCK_SZ  (512)
+#define CONFIG_BLOCK_MAX (64 * 1024)
+
+#define CONFIG_MAX_DEVS     (1024)                   /* Open devices, indexed by fd */
+#define CONFIG_RING_SZ      (256)                    /* Max in-flight async requests */
+#define CONFIG_RING_WORKERS (4)
+#define CONFIG_MERGE_MAX    (32)                     /* Max requests merged into one access */
+#define CONFIG_STRIPE_MAX   (16)                     /* Members of a striped device */
+#define CONFIG_DIRECT_ALIGN (4096)                   /* Buffer alignment for O_DIRECT */
+#define CONFIG_MAX_QUEUES   (16)                     /* Hardware queues in multi-queue mode */
+
+#define CONFIG_LAT_HIST_SUB (5)                      /* Log-linear, 2^5 buckets per power of 2 */
+#define CONFIG_LAT_HIST_SZ  ((32 - CONFIG_LAT_HIST_SUB + 1) << CONFIG_LAT_HIST_SUB)
+#define CONFIG_RAND_SEED    (0x9E3779B97F4A7C15ULL)
 /******************************************************************************
 * SECTION: Macro Functions 
 *******************************************************************************/
 #define IGNORE_ARG(arg)         ((void)arg)
-#define IS_ADDR_ALIGN(addr)     (addr % CONFIG_BLOCK_SZ == 0)
-#define ADDR_ROUND_UP(addr)     ((addr / CONFIG_BLOCK_SZ) * CONFIG_BLOCK_SZ)
+#define IS_ADDR_ALIGN(dev, addr) (addr % (dev)->iounit_size == 0)
+#define IS_SIZE_ALIGN(dev, size) (size != 0 && size % (dev)->iounit_size == 0)
+#define ADDR_ROUND_UP(dev, addr) ((addr / (dev)->iounit_size) * (dev)->iounit_size)
+
+#define SET_HEAD(dev, ofs)      (__atomic_store_n(&(dev)->head, ofs, __ATOMIC_RELAXED))
+#define GET_CURSOR(dev)         (__atomic_load_n(&(dev)->cursor, __ATOMIC_RELAXED))
+#define SET_CURSOR(dev, ofs)    (__atomic_store_n(&(dev)->cursor, ofs, __ATOMIC_RELAXED))
+#define RING_SLOTS(dev)         ((dev)->nr_queues > 1 ? (dev)->nr_queues : 1)
+
+#define STAT_ADD(dev, cnt, n)   (__atomic_add_fetch(&(dev)->stats->cnt, n, __ATOMIC_RELAXED))
+#define STAT_GET(dev, cnt)      (__atomic_load_n(&(dev)->stats->cnt, __ATOMIC_RELAXED))
+#define STAT_SET(dev, cnt, n)   (__atomic_store_n(&(dev)->stats->cnt, n, __ATOMIC_RELAXED))
+#define INC_READCNT(dev)        (STAT_ADD(dev, read_cnt, 1))
+#define INC_WRITECNT(dev)       (STAT_ADD(dev, write_cnt, 1))
+#define INC_SEEKCNT(dev)        (STAT_ADD(dev, seek_cnt, 1))
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+struct lat_hist
+{
+    unsigned long long count;
+    unsigned long long max;
+    unsigned long long buckets[CONFIG_LAT_HIST_SZ];
+};
+
+struct ddriver_ring
+{
+    pthread_mutex_t    lock;
+    pthread_cond_t     sq_cond;                      /* Submission available or head freed */
+    pthread_cond_t     cq_cond;                      /* New completion available */
+    struct ddriver_sqe pending[CONFIG_RING_SZ];      /* In submission order */
+    struct ddriver_cqe cq[CONFIG_RING_SZ];
+    int                nr_pending;
+    unsigned int       cq_head;
+    unsigned int       cq_tail;
+    int                inflight;                     /* Submitted but not reaped */
+    int                running;
+    int                busy;                         /* Workers dispatching, one per queue */
+    int                nr_workers;
+    int                sched;                        /* DDRIVER_SCHED_* */
+    int                scan_up;                      /* SCAN sweep direction */
+    pthread_t          workers[CONFIG_MAX_QUEUES];
+};
+
+struct stripe_part;
+
+struct stripe_worker                                 /* Runs the parts of one member */
+{
+    struct ddriver     *dev;                         /* The striped device */
+    pthread_t          thread;
+    pthread_cond_t     cond;                         /* Part queued, or stopping */
+    struct stripe_part *head;                        /* Queued parts, in arrival order */
+    struct stripe_part *tail;
+    int                running;
+};
+
+struct ddriver_queue                                 /* Serves one request at a time, no head */
+{
+    pthread_mutex_t    lock;
+    unsigned long long clock;                        /* Emulated time this queue was busy */
+    unsigned long long rand_state;
+};
+
+struct ddriver
+{
+    int  fd;                                         /* Image fd, also the device handle */
+    FILE *log;                                       /* <image>_log */
+    FILE *trace;                                     /* Binary request trace, or NULL */
+    struct timespec trace_start;
+    off_t head;                                      /* Emulated head position, latency only */
+    off_t cursor;                                    /* Position of seek, read and write */
+    char *map;                                       /* Image mapping in mmap mode */
+    int  vclock;                                     /* Account latency without sleeping */
+    int  direct;                                     /* Image opened with O_DIRECT */
+    char *bounce;                                    /* Aligned copy of unaligned buffers */
+    size_t bounce_sz;
+    struct ddriver_live_stats *stats;                /* Shared page, or local_stats */
+    struct ddriver_live_stats local_stats;
+    struct ddriver_lat_dist dist;                    /* Per-op latency distribution */
+    unsigned long long rand_state;
+    struct lat_hist hist[2];                         /* Indexed by DDRIVER_OP_* */
+    int  read_lat;                                   /* us */
+    int  write_lat;                                  /* us */
+    int  seek_lat;                                   /* us per revolution */
+    int  track_num;
+    int  major_num;
+    long long layout_size;
+    int  iounit_size;
+    unsigned char *written;                          /* One bit per IO unit, clear for holes */
+    int  base_fd;                                    /* Read-only base under an overlay, or -1 */
+    unsigned char *cow_map;                          /* One bit per IO unit, set if in the overlay */
+    long long cow_map_sz;
+    struct ddriver *members[CONFIG_STRIPE_MAX];      /* Striped device when nr_members > 0 */
+    int  nr_members;
+    int  stripe_sz;                                  /* Bytes per member before moving on */
+    struct stripe_worker stripe_workers[CONFIG_STRIPE_MAX];
+    pthread_mutex_t stripe_lock;                     /* Worker queues and part completion */
+    pthread_cond_t  stripe_done;                     /* A worker finished a part */
+    struct ddriver_queue queues[CONFIG_MAX_QUEUES];
+    int  nr_queues;                                  /* Multi-queue mode when > 0 */
+    unsigned int queue_next;                         /* Round robin of requests over queues */
+    pthread_mutex_t lock;                            /* Serializes the emulated head */
+    struct ddriver_ring ring;                        /* Async requests of this device */
+};
+
+struct stripe_part                                   /* Share of one member in a striped request */
+{
+    struct ddriver *member;
+    int            op;
+    struct iovec  *iov;
+    int            iovcnt;
+    off_t          offset;                           /* In the member */
+    size_t         size;
+    int            res;
+    long long      lat;                              /* Emulated cost on the member */
+    struct stripe_part *next;                        /* In the member worker's queue */
+    int            done;
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+/* Defaults of a newly opened device
+ * reference: https://en.wikipedia.org/wiki/Hard_disk_drive_performance_characteristics */
+static const struct ddriver disk_template = {
+    .head        = 0,
+    .map         = NULL,
+    .log         = NULL,
+    .vclock      = 0,
+    .read_lat    = 2000,    /* 2ms */       
+    .write_lat   = 1000,    /* 1ms */
+    .seek_lat    = 4170,    /* 4.17ms per 360 degree */
+    .major_num   = 0,
+    .track_num   = 100,
+    .layout_size = CONFIG_DISK_SZ,
+    .iounit_size = CONFIG_BLOCK_SZ,
+    .base_fd     = -1,
+    .lock        = PTHREAD_MUTEX_INITIALIZER,
+    .stripe_lock = PTHREAD_MUTEX_INITIALIZER,
+    .stripe_done = PTHREAD_COND_INITIALIZER,
+    .ring        = {
+        .lock    = PTHREAD_MUTEX_INITIALIZER,
+        .sq_cond = PTHREAD_COND_INITIALIZER,
+        .cq_cond = PTHREAD_COND_INITIALIZER,
+        .running = 0,
+        .sched   = DDRIVER_SCHED_CLOOK,
+        .scan_up = 1
+    }
+};
+
+static struct ddriver *devices[CONFIG_MAX_DEVS];     /* Indexed by fd */
+static pthread_mutex_t devices_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Indexed by DDRIVER_PROFILE_*, all latencies in us */
+static const struct ddriver_latency profiles[] = {
+    [DDRIVER_PROFILE_HDD]  = { .read_lat = 2000, .write_lat = 1000, .seek_lat = 4170, .track_num = 100 },
+    [DDRIVER_PROFILE_SSD]  = { .read_lat = 90,   .write_lat = 250,  .seek_lat = 0,    .track_num = 1   },
+    [DDRIVER_PROFILE_NVME] = { .read_lat = 15,   .write_lat = 20,   .seek_lat = 0,    .track_num = 1   },
+    [DDRIVER_PROFILE_ZERO] = { .read_lat = 0,    .write_lat = 0,    .seek_lat = 0,    .track_num = 1   },
+};
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+struct ddriver* dev_alloc(int fd) {
+    struct ddriver *dev = malloc(sizeof(struct ddriver));
+    int i;
+
+    if (dev == NULL) {
+        return NULL;
+    }
+    *dev = disk_template;
+    dev->fd = fd;
+    dev->stats = &dev->local_stats;
+    pthread_mutex_init(&dev->lock, NULL);
+    pthread_mutex_init(&dev->ring.lock, NULL);
+    for (i = 0; i < CONFIG_MAX_QUEUES; i++) {
+        pthread_mutex_init(&dev->queues[i].lock, NULL);
+    }
+    pthread_mutex_init(&dev->stripe_lock, NULL);
+    pthread_cond_init(&dev->stripe_done, NULL);
+    for (i = 0; i < CONFIG_STRIPE_MAX; i++) {
+        dev->stripe_workers[i].dev = dev;
+        pthread_cond_init(&dev->stripe_workers[i].cond, NULL);
+    }
+    pthread_cond_init(&dev->ring.sq_cond, NULL);
+    pthread_cond_init(&dev->ring.cq_cond, NULL);
+    return dev;
+}
+
+struct ddriver* dev_get(int fd) {
+    struct ddriver *dev = NULL;
+
+    if (fd >= 0 && fd < CONFIG_MAX_DEVS) {
+        pthread_mutex_lock(&devices_lock);
+        dev = devices[fd];
+        pthread_mutex_unlock(&devices_lock);
+    }
+    if (dev == NULL) {
+        user_panic("fd %d is not an open device", fd);
+    }
+    return dev;
+}
+
+int check_valid(struct ddriver *dev, size_t size) {
+    if (size != dev->iounit_size){
+        user_alert(dev, "io size %ld should align to %d", size, dev->iounit_size);
+        return -EIO;
+    }
+    return 0;
+}
+
+int check_valid_blocks(struct ddriver *dev, size_t size) {
+    if (!IS_SIZE_ALIGN(dev, size)){
+        user_alert(dev, "io size %ld should be multiple of %d", size, dev->iounit_size);
+        return -EIO;
+    }
+    return 0;
+}
+
+int check_valid_iov(struct ddriver *dev, const struct iovec *iov, int iovcnt, size_t *total) {
+    int i;
+    *total = 0;
+    if (iovcnt <= 0) {
+        user_alert(dev, "iovcnt %d should be positive", iovcnt);
+        return -EINVAL;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        if (check_valid_blocks(dev, iov[i].iov_len) < 0)
+            return -EIO;
+        *total += iov[i].iov_len;
+    }
+    return 0;
+}
+
+int check_valid_range(struct ddriver *dev, off_t offset, size_t size) {
+    if (!IS_ADDR_ALIGN(dev, offset)) {
+        user_alert(dev, "offset %ld must be aligned to block size %d", 
+                      offset, dev->iounit_size);
+        return -EINVAL;
+    }
+    if (check_valid_blocks(dev, size) < 0)
+        return -EIO;
+    if (offset < 0 || offset + size > dev->layout_size) {
+        user_alert(dev, "io [%ld, %ld) out of device range %lld", 
+                      offset, offset + size, dev->layout_size);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+void emulate_delay(struct ddriver *dev, long long us) {
+    if (us <= 0) {
+        return;
+    }
+    STAT_ADD(dev, elapsed_us, us);
+    if (!dev->vclock) {                               /* Virtual clock only accounts */
+        usleep(us);
+    }
+}
+
+long long rotate_cost(struct ddriver *dev, off_t start, off_t end) {
+    long long bytes_per_track;
+    int lat_per_track = dev->seek_lat;
+    long long distance;
+
+    if (lat_per_track == 0) {                         /* No mechanical positioning */
+        return 0;
+    }
+    bytes_per_track = dev->layout_size / dev->track_num;
+    distance = llabs(end - start) % bytes_per_track; 
+    return distance * lat_per_track / bytes_per_track;
+}
+
+int emulate_rotate(struct ddriver *dev, off_t start, off_t end) {
+    emulate_delay(dev, rotate_cost(dev, start, end));
+    return 0;
+}
+
+unsigned long long rand_next(unsigned long long *state) {  /* xorshift64* */
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+double rand_normal(unsigned long long *state) {       /* Box-Muller */
+    double u1 = ((rand_next(state) >> 11) + 1) * (1.0 / 9007199254740993.0);
+    double u2 = (rand_next(state) >> 11) * (1.0 / 9007199254740992.0);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+long long sample_latency(struct ddriver *dev, unsigned long long *state, int base) {
+    double lat = base;
+
+    if (base == 0 || dev->dist.type == DDRIVER_DIST_FIXED) {
+        return base;
+    }
+    if (dev->dist.type == DDRIVER_DIST_LOGNORMAL) {   /* Median stays at base */
+        lat *= exp(dev->dist.sigma_milli / 1000.0 * rand_normal(state));
+    }
+    if (dev->dist.spike_ppm > 0 && rand_next(state) % 1000000 < dev->dist.spike_ppm) {
+        lat *= dev->dist.spike_mult;
+    }
+    return (long long)lat;
+}
+
+int set_dist(struct ddriver *dev, const struct ddriver_lat_dist *dist) {
+    if (dist->type < DDRIVER_DIST_FIXED || dist->type > DDRIVER_DIST_BIMODAL
+        || dist->sigma_milli < 0 || dist->spike_ppm < 0 || dist->spike_ppm > 1000000
+        || dist->spike_mult < 1) {
+        user_alert(dev, "invalid latency distribution %d", dist->type);
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&dev->lock);
+    dev->dist = *dist;
+    pthread_mutex_unlock(&dev->lock);
+    return 0;
+}
+
+int hist_index(unsigned long long us) {
+    const int sub = 1 << CONFIG_LAT_HIST_SUB;
+    int msb, idx;
+
+    if (us < sub) {
+        return us;
+    }
+    msb = 63 - __builtin_clzll(us);
+    idx = (msb - CONFIG_LAT_HIST_SUB + 1) * sub 
+          + ((us >> (msb - CONFIG_LAT_HIST_SUB)) & (sub - 1));
+    return idx < CONFIG_LAT_HIST_SZ ? idx : CONFIG_LAT_HIST_SZ - 1;
+}
+
+unsigned long long hist_value(int idx) {              /* Upper bound of a bucket */
+    const int sub = 1 << CONFIG_LAT_HIST_SUB;
+    int shift = idx / sub - 1;
+
+    if (idx < sub) {
+        return idx;
+    }
+    return ((unsigned long long)(sub + idx % sub + 1) << shift) - 1;
+}
+
+void hist_record(struct lat_hist *hist, unsigned long long us) {
+    hist->buckets[hist_index(us)]++;
+    hist->count++;
+    if (us > hist->max) {
+        hist->max = us;
+    }
+}
+
+unsigned int hist_percentile(const struct lat_hist *hist, int permille) {
+    unsigned long long rank = (hist->count * permille + 999) / 1000;
+    unsigned long long seen = 0;
+    int idx;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    for (idx = 0; idx < CONFIG_LAT_HIST_SZ; idx++) {
+        seen += hist->buckets[idx];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    return hist_value(idx) < hist->max ? hist_value(idx) : hist->max;
+}
+
+void hist_report(const struct lat_hist *hist, struct ddriver_lat_pctl *pctl) {
+    pctl->count = hist->count;
+    pctl->p50   = hist_percentile(hist, 500);
+    pctl->p90   = hist_percentile(hist, 900);
+    pctl->p99   = hist_percentile(hist, 990);
+    pctl->p999  = hist_percentile(hist, 999);
+    pctl->max   = hist->max;
+}
+
+void bitmap_mark(struct ddriver *dev, unsigned char *bits, off_t offset, off_t size, int set) {
+    long long unit, end;
+
+    end = (offset + size) / dev->iounit_size;
+    for (unit = offset / dev->iounit_size; unit < end; unit++) {
+        if ((unit & 7) == 0 && end - unit >= 8) {     /* Whole bytes at a time */
+            bits[unit >> 3] = set ? 0xff : 0;
+            unit += 7;
+        }
+        else if (set) {
+            bits[unit >> 3] |= (1 << (unit & 7));
+        }
+        else {
+            bits[unit >> 3] &= ~(1 << (unit & 7));
+        }
+    }
+}
+
+int cow_test(struct ddriver *dev, off_t offset) {
+    long long unit = offset / dev->iounit_size;
+
+    return (dev->cow_map[unit >> 3] & (1 << (unit & 7))) != 0;
+}
+
+ssize_t cow_read(struct ddriver *dev, const struct iovec *iov, int iovcnt, off_t offset) {
+    struct iovec *slice = malloc(sizeof(struct iovec) * iovcnt);
+    size_t size = 0, done = 0, in = 0, run, n;
+    int i, fd, cnt;
+
+    if (slice == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        size += iov[i].iov_len;
+    }
+    for (i = 0; done < size; done += run) {           /* One read per run from the same image */
+        fd = cow_test(dev, offset + done) ? dev->fd : dev->base_fd;
+        for (run = dev->iounit_size; done + run < size; run += dev->iounit_size) {
+            if ((cow_test(dev, offset + done + run) ? dev->fd : dev->base_fd) != fd)
+                break;
+        }
+        for (cnt = 0, n = 0; n < run; cnt++) {
+            slice[cnt].iov_base = (char *)iov[i].iov_base + in;
+            slice[cnt].iov_len = iov[i].iov_len - in < run - n ? iov[i].iov_len - in : run - n;
+            n += slice[cnt].iov_len;
+            in += slice[cnt].iov_len;
+            if (in == iov[i].iov_len) {
+                i++;
+                in = 0;
+            }
+        }
+        if (preadv(fd, slice, cnt, offset + done) != (ssize_t)run) {
+            free(slice);
+            return -1;
+        }
+    }
+    free(slice);
+    return done;
+}
+
+int iov_aligned(const struct iovec *iov, int iovcnt) {
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        if ((unsigned long)iov[i].iov_base % CONFIG_DIRECT_ALIGN != 0
+            || iov[i].iov_len % CONFIG_BLOCK_SZ != 0)
+            return 0;
+    }
+    return 1;
+}
+
+ssize_t dev_io(struct ddriver *dev, int op, const struct iovec *iov, int iovcnt, off_t offset);
+
+ssize_t bounce_io(struct ddriver *dev, int op, const struct iovec *iov, int iovcnt, off_t offset) {
+    struct iovec bounce;
+    size_t size = 0, done;
+    ssize_t ret;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        size += iov[i].iov_len;
+    }
+    if (size > dev->bounce_sz) {                      /* Caller holds dev->lock */
+        free(dev->bounce);
+        dev->bounce_sz = 0;
+        if (posix_memalign((void **)&dev->bounce, CONFIG_DIRECT_ALIGN, size) != 0) {
+            dev->bounce = NULL;
+            errno = ENOMEM;
+            return -1;
+        }
+        dev->bounce_sz = size;
+    }
+    for (i = 0, done = 0; op == DDRIVER_OP_WRITE && i < iovcnt; i++) {
+        memcpy(dev->bounce + done, iov[i].iov_base, iov[i].iov_len);
+        done += iov[i].iov_len;
+    }
+    bounce.iov_base = dev->bounce;
+    bounce.iov_len = size;
+    ret = dev_io(dev, op, &bounce, 1, offset);
+    for (i = 0, done = 0; op == DDRIVER_OP_READ && ret > 0 && i < iovcnt; i++) {
+        memcpy(iov[i].iov_base, dev->bounce + done, iov[i].iov_len);
+        done += iov[i].iov_len;
+    }
+    return ret;
+}
+
+ssize_t dev_io(struct ddriver *dev, int op, const struct iovec *iov, int iovcnt, off_t offset) {
+    size_t done = 0;
+    ssize_t ret;
+    int i;
+
+    if (dev->direct && !iov_aligned(iov, iovcnt)) {
+        return bounce_io(dev, op, iov, iovcnt, offset);
+    }
+    if (dev->cow_map != NULL) {                       /* Writes land in the overlay only */
+        if (op == DDRIVER_OP_READ)
+            return cow_read(dev, iov, iovcnt, offset);
+        ret = pwritev(dev->fd, iov, iovcnt, offset);
+        if (ret > 0)
+            bitmap_mark(dev, dev->cow_map, offset, ret, 1);
+        return ret;
+    }
+    if (dev->map == NULL) {
+        return op == DDRIVER_OP_WRITE ? pwritev(dev->fd, iov, iovcnt, offset)
+                                      : preadv(dev->fd, iov, iovcnt, offset);
+    }
+    for (i = 0; i < iovcnt; i++) {
+        if (op == DDRIVER_OP_WRITE)
+            memcpy(dev->map + offset + done, iov[i].iov_base, iov[i].iov_len);
+        else
+            memcpy(iov[i].iov_base, dev->map + offset + done, iov[i].iov_len);
+        done += iov[i].iov_len;
+    }
+    return done;
+}
+
+int dev_reset(struct ddriver *dev) {
+    struct stat st;
+
+    if (dev->cow_map != NULL) {                       /* Overlay dropped, base shows through */
+        memset(dev->cow_map, 0, dev->cow_map_sz);
+    }
+    if (fstat(dev->fd, &st) < 0) {
+        return -errno;
+    }
+    if (fallocate(dev->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, st.st_size) == 0) {
+        return 0;
+    }
+    user_alert(dev, "punch hole unsupported (%s), truncating", strerror(errno));
+    if (ftruncate(dev->fd, 0) < 0 || ftruncate(dev->fd, st.st_size) < 0) {
+        return -errno;                                /* Mapping stays valid once re-extended */
+    }
+    return 0;
+}
+
+int dev_discard(struct ddriver *dev, off_t offset, off_t len) {
+    static const char zero[4096] __attribute__((aligned(CONFIG_DIRECT_ALIGN)));
+    off_t done;
+    ssize_t ret;
+
+    if (fallocate(dev->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len) == 0) {
+        return 0;
+    }
+    if (dev->map != NULL) {                           /* Still reads back as zero */
+        memset(dev->map + offset, 0, len);
+        return 0;
+    }
+    for (done = 0; done < len; done += ret) {
+        ret = pwrite(dev->fd, zero, len - done < sizeof(zero) ? len - done : sizeof(zero), 
+                     offset + done);
+        if (ret < 0) {
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+int trace_open(struct ddriver *dev, const char *path) {
+    struct ddriver_trace_hdr hdr = {
+        .magic       = DDRIVER_TRACE_MAGIC,
+        .iounit_size = dev->iounit_size,
+        .disk_size   = dev->layout_size
+    };
+
+    dev->trace = fopen(path, "w");
+    if (dev->trace == NULL) {
+        user_panic("can't open trace %s: %s", path, strerror(errno));
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &dev->trace_start);
+    fwrite(&hdr, sizeof(hdr), 1, dev->trace);
+    return 0;
+}
+
+void stats_open(struct ddriver *dev, const char *path) {
+    char stats_path[PATH_MAX] = {0};
+    struct ddriver_live_stats *stats;
+    int fd;
+
+    snprintf(stats_path, sizeof(stats_path), "%s" DEVICE_STATS, path);
+    fd = open(stats_path, O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(struct ddriver_live_stats)) < 0) {
+        user_alert(dev, "no live stats in %s: %s", stats_path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    stats = mmap(NULL, sizeof(struct ddriver_live_stats), PROT_READ | PROT_WRITE, 
+                 MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED) {
+        user_alert(dev, "no live stats in %s: %s", stats_path, strerror(errno));
+        return;
+    }
+    memset(stats, 0, sizeof(struct ddriver_live_stats));
+    stats->pid         = getpid();
+    stats->disk_size   = dev->layout_size;
+    stats->iounit_size = dev->iounit_size;
+    stats->nr_queues   = dev->nr_queues;
+    __atomic_store_n(&stats->magic, DDRIVER_STATS_MAGIC, __ATOMIC_RELEASE);
+    dev->stats = stats;                               /* Counters are still zero here */
+}
+
+void trace_record(struct ddriver *dev, int op, off_t offset, size_t size) {
+    struct ddriver_trace_rec rec;
+    struct timespec now;
+
+    if (dev->trace == NULL) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    rec.ts_us  = (now.tv_sec - dev->trace_start.tv_sec) * 1000000LL 
+               + (now.tv_nsec - dev->trace_start.tv_nsec) / 1000;
+    rec.offset = offset;
+    rec.size   = size;
+    rec.op     = op;
+    fwrite(&rec, sizeof(rec), 1, dev->trace);         /* stdio locks per call */
+}
+
+void account_seek(struct ddriver *dev, off_t from, off_t to) {
+    INC_SEEKCNT(dev);
+    STAT_ADD(dev, seek_dist, llabs(to - from));
+}
+
+long long region_size(struct ddriver *dev) {
+    return (dev->layout_size + DDRIVER_STATS_REGIONS - 1) / DDRIVER_STATS_REGIONS;
+}
+
+int region_of(struct ddriver *dev, off_t offset) {
+    return offset / region_size(dev);
+}
+
+void account_io(struct ddriver *dev, int op, off_t offset, size_t size, long long lat) {
+    hist_record(&dev->hist[op], lat);                 /* Caller holds dev->lock */
+
+    SET_HEAD(dev, offset + size);
+    if (op == DDRIVER_OP_WRITE) {
+        INC_WRITECNT(dev);
+        STAT_ADD(dev, write_bytes, size);
+    }
+    else {
+        INC_READCNT(dev);
+        STAT_ADD(dev, read_bytes, size);
+    }
+    STAT_ADD(dev, region_cnt[op][region_of(dev, offset)], 1);
+}
+
+void emulate_access(struct ddriver *dev, int op, off_t offset, size_t size) {
+    long long lat = 0;                                /* Caller holds dev->lock */
+
+    if (offset != dev->head && dev->nr_queues == 0) {
+        account_seek(dev, dev->head, offset);
+        lat = rotate_cost(dev, dev->head, offset);
+    }
+    lat += sample_latency(dev, &dev->rand_state, 
+                          op == DDRIVER_OP_WRITE ? dev->write_lat : dev->read_lat);
+    emulate_delay(dev, lat);
+    account_io(dev, op, offset, size, lat);
+}
+
+void extent_mark(struct ddriver *dev, off_t offset, off_t size, int written) {
+    if (dev->written != NULL) {
+        bitmap_mark(dev, dev->written, offset, size, written);
+    }
+}
+
+int extent_is_hole(struct ddriver *dev, off_t offset, off_t size) {
+    long long unit, end;
+
+    if (dev->written == NULL) {                       /* Untracked, assume data */
+        return 0;
+    }
+    end = (offset + size) / dev->iounit_size;
+    for (unit = offset / dev->iounit_size; unit < end; unit++) {
+        if ((unit & 7) == 0 && end - unit >= 8) {
+            if (dev->written[unit >> 3] != 0)
+                return 0;
+            unit += 7;
+        }
+        else if (dev->written[unit >> 3] & (1 << (unit & 7))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int extent_fd_is_hole(int fd, off_t offset, off_t size) {
+    off_t data = lseek(fd, offset, SEEK_DATA);
+
+    if (data < 0) {                                   /* No SEEK_DATA, assume data */
+        return errno == ENXIO;
+    }
+    return data >= offset + size;
+}
+
+int extent_confirm_hole(struct ddriver *dev, off_t offset, off_t size) {
+    /* Other handles of the image, ddriver_replay or other processes write
+     * behind our bitmap, ask the image before answering with zeroes */
+    if (extent_fd_is_hole(dev->fd, offset, size)
+        && (dev->base_fd < 0 || extent_fd_is_hole(dev->base_fd, offset, size))) {
+        return 1;
+    }
+    extent_mark(dev, offset, size, 1);                /* Caller holds dev->lock */
+    return 0;
+}
+
+void extent_scan(struct ddriver *dev, int fd) {
+    off_t data, hole = 0;
+
+    while (hole < dev->layout_size) {                 /* Learn what the image already holds */
+        data = lseek(fd, hole, SEEK_DATA);
+        if (data < 0) {
+            if (errno != ENXIO) {                     /* No SEEK_DATA, treat all as data */
+                extent_mark(dev, 0, dev->layout_size, 1);
+            }
+            break;
+        }
+        if (data >= dev->layout_size) {
+            break;
+        }
+        hole = lseek(fd, data, SEEK_HOLE);
+        if (hole < 0 || hole > dev->layout_size) {
+            hole = dev->layout_size;
+        }
+        data = data / dev->iounit_size * dev->iounit_size;
+        hole = (hole + dev->iounit_size - 1) / dev->iounit_size * dev->iounit_size;
+        extent_mark(dev, data, hole - data, 1);
+    }
+}
+
+void extent_init(struct ddriver *dev) {
+    free(dev->written);
+    dev->written = calloc((dev->layout_size / dev->iounit_size + 7) / 8, 1);
+    if (dev->written == NULL) {
+        return;
+    }
+    extent_scan(dev, dev->fd);
+    if (dev->base_fd >= 0) {                          /* Overlay holes may show the base */
+        extent_scan(dev, dev->base_fd);
+    }
+}
+
+int stripe_io(struct ddriver *dev, int op, const struct iovec *iov, int iovcnt, off_t offset, size_t size);
+
+/* Requests take turns over the device's queues. A sleeping queue is skipped for
+ * the next idle one, the virtual clock never sleeps so its turns stay even */
+struct ddriver_queue* mq_pick(struct ddriver *dev) {
+    unsigned int first = __atomic_fetch_add(&dev->queue_next, 1, __ATOMIC_RELAXED);
+    struct ddriver_queue *queue;
+    int i;
+
+    for (i = 0; i < dev->nr_queues && !dev->vclock; i++) {
+        queue = &dev->queues[(first + i) % dev->nr_queues];
+        if (pthread_mutex_trylock(&queue->lock) == 0)
+            return queue;
+    }
+    queue = &dev->queues[first % dev->nr_queues];     /* All busy, wait for our turn */
+    pthread_mutex_lock(&queue->lock);
+    return queue;
+}
+
+int mq_io(struct ddriver *dev, int op, const struct iovec *iov, int iovcnt, off_t offset, size_t size) {
+    struct ddriver_queue *queue = mq_pick(dev);       /* Locked, other queues proceed meanwhile */
+    unsigned long long clock, cur;
+    int shared = dev->direct || dev->cow_map != NULL; /* Bounce buffer and block map */
+    long long lat;
+    ssize_t ret;
+
+    lat = sample_latency(dev, &queue->rand_state, 
+                         op == DDRIVER_OP_WRITE ? dev->write_lat : dev->read_lat);
+    queue->clock += lat;
+    clock = queue->clock;
+    if (!dev->vclock && lat > 0) {
+        usleep(lat);
+    }
+    if (shared)
+        pthread_mutex_lock(&dev->lock);
+    ret = dev_io(dev, op, iov, iovcnt, offset);
+    if (shared)
+        pthread_mutex_unlock(&dev->lock);
+    pthread_mutex_unlock(&queue->lock);
+
+    cur = STAT_GET(dev, elapsed_us);                  /* Device time is the busiest queue */
+    while (clock > cur && !__atomic_compare_exchange_n(&dev->stats->elapsed_us, &cur, clock, 0, 
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    if (ret != size) {
+        user_panic("%s error: %s", op == DDRIVER_OP_WRITE ? "write" : "read", 
+                   strerror(errno));
+        return -EIO;
+    }
+    pthread_mutex_lock(&dev->lock);
+    account_io(dev, op, offset, size, lat);
+    pthread_mutex_unlock(&dev->lock);
+    return size;
+}
+
+int set_queues(struct ddriver *dev, int nr_queues) {
+    int i;
+
+    if (nr_queues < 0 || nr_queues > CONFIG_MAX_QUEUES) {
+        user_alert(dev, "queues %d should be in [0, %d]", nr_queues, CONFIG_MAX_QUEUES);
+        return -EINVAL;
+    }
+    dev->nr_queues = nr_queues;
+    dev->queue_next = 0;
+    for (i = 0; i < nr_queues; i++) {                 /* Queues sample independently */
+        dev->queues[i].clock = 0;
+        dev->queues[i].rand_state = dev->rand_state + i + 1;
+    }
+    return 0;
+}
+
+int emulate_io(struct ddriver *dev, int op, const struct iovec *iov, int iovcnt, off_t offset, size_t size) {
+    int i;
+    int res = check_valid_range(dev, offset, size);
+    if (res < 0)
+        return res;
+    trace_record(dev, op, offset, size);
+    if (dev->nr_members > 0) {
+        return stripe_io(dev, op, iov, iovcnt, offset, size);
+    }
+
+    pthread_mutex_lock(&dev->lock);
+    if (op == DDRIVER_OP_READ && extent_is_hole(dev, offset, size)
+        && extent_confirm_hole(dev, offset, size)) {
+        for (i = 0; i < iovcnt; i++) {                /* Never written, no device access */
+            memset(iov[i].iov_base, 0, iov[i].iov_len);
+        }
+        if (offset != dev->head && dev->nr_queues == 0) {
+            account_seek(dev, dev->head, offset);
+        }
+        account_io(dev, op, offset, size, 0);         /* Still a read to the counters, at no cost */
+        pthread_mutex_unlock(&dev->lock);
+        return size;
+    }
+    if (op == DDRIVER_OP_WRITE) {
+        extent_mark(dev, offset, size, 1);
+    }
+    if (dev->nr_queues > 0) {
+        pthread_mutex_unlock(&dev->lock);
+        return mq_io(dev, op, iov, iovcnt, offset, size);
+    }
+    emulate_access(dev, op, offset, size);
+    if (dev_io(dev, op, iov, iovcnt, offset) != size) {
+        pthread_mutex_unlock(&dev->lock);
+        user_panic("%s error: %s", op == DDRIVER_OP_WRITE ? "write" : "read", 
+                   strerror(errno));
+        return -EIO;
+    }
+    pthread_mutex_unlock(&dev->lock);
+    return size;
+}
+
+int cursor_io(struct ddriver *dev, int op, const struct iovec *iov, int iovcnt, size_t size) {
+    off_t offset = GET_CURSOR(dev);                   /* Positional I/O leaves it alone */
+    int res = emulate_io(dev, op, iov, iovcnt, offset, size);
+
+    if (res >= 0)
+        SET_CURSOR(dev, offset + size);
+    return res;
+}
+
+void stats_reset(struct ddriver *dev) {
+    int i, op;
+                                                      /* Page is shared with other openers 
+                                                         and ddriver_stat, store per counter */
+    STAT_SET(dev, read_cnt, 0);
+    STAT_SET(dev, write_cnt, 0);
+    STAT_SET(dev, seek_cnt, 0);
+    STAT_SET(dev, read_bytes, 0);
+    STAT_SET(dev, write_bytes, 0);
+    STAT_SET(dev, seek_dist, 0);
+    STAT_SET(dev, elapsed_us, 0);
+    for (i = 0; i < dev->nr_queues; i++) {
+        dev->queues[i].clock = 0;
+    }
+    for (op = DDRIVER_OP_READ; op <= DDRIVER_OP_WRITE; op++) {
+        for (i = 0; i < DDRIVER_STATS_REGIONS; i++) {
+            STAT_SET(dev, region_cnt[op][i], 0);
+        }
+    }
+    memset(dev->hist, 0, sizeof(dev->hist));
+}
+
+void stats_report(struct ddriver *dev, struct ddriver_stats_v2 *stats) {
+    int op, idx, bucket;
+    unsigned long long value;
+
+    memset(stats, 0, sizeof(struct ddriver_stats_v2));
+    stats->read_cnt    = STAT_GET(dev, read_cnt);
+    stats->write_cnt   = STAT_GET(dev, write_cnt);
+    stats->seek_cnt    = STAT_GET(dev, seek_cnt);
+    stats->read_bytes  = STAT_GET(dev, read_bytes);
+    stats->write_bytes = STAT_GET(dev, write_bytes);
+    stats->seek_dist   = STAT_GET(dev, seek_dist);
+    stats->elapsed_us  = STAT_GET(dev, elapsed_us);
+    stats->region_sz   = region_size(dev);
+    for (op = DDRIVER_OP_READ; op <= DDRIVER_OP_WRITE; op++) {
+        for (idx = 0; idx < CONFIG_LAT_HIST_SZ; idx++) {
+            value  = hist_value(idx);                 /* Fold into power-of-2 buckets */
+            bucket = value < 2 ? 0 : 63 - __builtin_clzll(value);
+            if (bucket >= DDRIVER_STATS_HIST_SZ)
+                bucket = DDRIVER_STATS_HIST_SZ - 1;
+            stats->lat_hist[op][bucket] += dev->hist[op].buckets[idx];
+        }
+    }
+    memcpy(stats->region_cnt, dev->stats->region_cnt, sizeof(stats->region_cnt));
+}
+
+int set_latency(struct ddriver *dev, const struct ddriver_latency *lat) {
+    if (lat->read_lat < 0 || lat->write_lat < 0 || lat->seek_lat < 0 
+        || lat->track_num <= 0 || lat->track_num > dev->layout_size / dev->iounit_size) {
+        user_alert(dev, "invalid latency r %d w %d s %d t %d", lat->read_lat, 
+                   lat->write_lat, lat->seek_lat, lat->track_num);
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&dev->lock);
+    dev->read_lat  = lat->read_lat;
+    dev->write_lat = lat->write_lat;
+    dev->seek_lat  = lat->seek_lat;
+    dev->track_num = lat->track_num;
+    pthread_mutex_unlock(&dev->lock);
+    return 0;
+}
+
+int set_profile(struct ddriver *dev, int profile) {
+    if (profile < 0 || profile >= (int)(sizeof(profiles) / sizeof(profiles[0]))) {
+        user_alert(dev, "unknown latency profile %d", profile);
+        return -EINVAL;
+    }
+    return set_latency(dev, &profiles[profile]);
+}
+
+int parse_profile(const char *name) {
+    if (strcmp(name, "hdd") == 0)  return DDRIVER_PROFILE_HDD;
+    if (strcmp(name, "ssd") == 0)  return DDRIVER_PROFILE_SSD;
+    if (strcmp(name, "nvme") == 0) return DDRIVER_PROFILE_NVME;
+    if (strcmp(name, "zero") == 0) return DDRIVER_PROFILE_ZERO;
+    user_panic("unknown DDRIVER_PROFILE [%s], using hdd", name);
+    return DDRIVER_PROFILE_HDD;
+}
+
+int parse_sched(const char *name) {
+    if (strcmp(name, "clook") == 0) return DDRIVER_SCHED_CLOOK;
+    if (strcmp(name, "noop") == 0)  return DDRIVER_SCHED_NOOP;
+    if (strcmp(name, "scan") == 0)  return DDRIVER_SCHED_SCAN;
+    user_panic("unknown DDRIVER_SCHED [%s], using clook", name);
+    return DDRIVER_SCHED_CLOOK;
+}
+
+int set_sched(struct ddriver *dev, int sched) {
+    if (sched < DDRIVER_SCHED_CLOOK || sched > DDRIVER_SCHED_SCAN) {
+        user_alert(dev, "unknown scheduler %d", sched);
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&dev->ring.lock);
+    dev->ring.sched = sched;
+    dev->ring.scan_up = 1;
+    pthread_mutex_unlock(&dev->ring.lock);
+    return 0;
+}
+
+void parse_dist(const char *spec, struct ddriver_lat_dist *dist) {
+    char type[16] = {0};
+
+    dist->spike_mult = 1;
+    sscanf(spec, "%15[^,],%d,%d,%d", type, &dist->sigma_milli, 
+           &dist->spike_ppm, &dist->spike_mult);
+    if (strcmp(type, "lognormal") == 0) {
+        dist->type = DDRIVER_DIST_LOGNORMAL;
+    }
+    else if (strcmp(type, "bimodal") == 0) {
+        dist->type = DDRIVER_DIST_BIMODAL;
+    }
+    else {
+        if (strcmp(type, "fixed") != 0) {
+            user_panic("unknown DDRIVER_LAT_DIST [%s], using fixed", spec);
+        }
+        dist->type = DDRIVER_DIST_FIXED;
+    }
+}
+
+long long parse_size(const char *str) {
+    char *end;
+    long long size = strtoll(str, &end, 0);
+
+    switch (*end)
+    {
+    case 'G': case 'g':
+        size <<= 10;
+        /* fall through */
+    case 'M': case 'm':
+        size <<= 10;
+        /* fall through */
+    case 'K': case 'k':
+        size <<= 10;
+        break;
+    default:
+        break;
+    }
+    return size;
+}
+
+int set_geometry(struct ddriver *dev, long long disk_size, int iounit_size) {
+    if (disk_size == 0) {
+        disk_size = CONFIG_DISK_SZ;
+    }
+    if (iounit_size == 0) {
+        iounit_size = CONFIG_BLOCK_SZ;
+    }
+    if (iounit_size < CONFIG_BLOCK_SZ || iounit_size > CONFIG_BLOCK_MAX
+        || (iounit_size & (iounit_size - 1)) != 0) {
+        user_alert(dev, "io unit %d should be a power of 2 in [%d, %d]", 
+                   iounit_size, CONFIG_BLOCK_SZ, CONFIG_BLOCK_MAX);
+        return -EINVAL;
+    }
+    if (disk_size < iounit_size || disk_size % iounit_size != 0) {
+        user_alert(dev, "disk size %lld should be a multiple of io unit %d", 
+                   disk_size, iounit_size);
+        return -EINVAL;
+    }
+    dev->layout_size = disk_size;
+    dev->iounit_size = iounit_size;
+    return 0;
+}
+
+void config_from_env(struct ddriver_config *config) {
+    char *env;
+
+    memset(config, 0, sizeof(struct ddriver_config));
+    env = getenv("DDRIVER_MMAP");
+    if (env != NULL && atoi(env) != 0) {
+        config->flags |= DDRIVER_FLAG_MMAP;
+    }
+    env = getenv("DDRIVER_DIRECT");
+    if (env != NULL && atoi(env) != 0) {
+        config->flags |= DDRIVER_FLAG_DIRECT;
+    }
+    env = getenv("DDRIVER_VCLOCK");
+    if (env != NULL && atoi(env) != 0) {
+        config->flags |= DDRIVER_FLAG_VCLOCK;
+    }
+    env = getenv("DDRIVER_PROFILE");
+    if (env != NULL) {
+        config->profile = parse_profile(env);
+    }
+    env = getenv("DDRIVER_LAT_DIST");                 /* type[,sigma_milli[,spike_ppm[,spike_mult]]] */
+    if (env != NULL) {
+        parse_dist(env, &config->dist);
+    }
+    env = getenv("DDRIVER_SCHED");
+    if (env != NULL) {
+        config->sched = parse_sched(env);
+    }
+    env = getenv("DDRIVER_SEED");
+    if (env != NULL) {
+        config->seed = strtoull(env, NULL, 0);
+    }
+    env = getenv("DDRIVER_DISK_SZ");                  /* Bytes, K/M/G suffix allowed */
+    if (env != NULL) {
+        config->disk_size = parse_size(env);
+    }
+    env = getenv("DDRIVER_IO_SZ");
+    if (env != NULL) {
+        config->iounit_size = parse_size(env);
+    }
+    env = getenv("DDRIVER_QUEUES");
+    if (env != NULL) {
+        config->nr_queues = atoi(env);
+    }
+    env = getenv("DDRIVER_TRACE");
+    if (env != NULL && env[0] != '\0') {
+        config->trace = env;
+    }
+    env = getenv("DDRIVER_BASE");                     /* Open the image as an overlay of it */
+    if (env != NULL && env[0] != '\0') {
+        config->base = env;
+    }
+}
+
+int emulate_discard(struct ddriver *dev, off_t offset, off_t len) {
+    int ret;
+
+    pthread_mutex_lock(&dev->lock);
+    ret = dev_discard(dev, offset, len);
+    if (ret == 0)
+        extent_mark(dev, offset, len, 0);
+    if (ret == 0 && dev->cow_map != NULL)             /* Zeroes shadow the base */
+        bitmap_mark(dev, dev->cow_map, offset, len, 1);
+    pthread_mutex_unlock(&dev->lock);
+    return ret;
+}
+
+int emulate_reset(struct ddriver *dev) {
+    int ret;
+
+    pthread_mutex_lock(&dev->lock);
+    ret = dev_reset(dev);
+    extent_mark(dev, 0, dev->layout_size, ret < 0);
+    if (dev->base_fd >= 0)
+        extent_scan(dev, dev->base_fd);
+    SET_HEAD(dev, 0);
+    SET_CURSOR(dev, 0);
+    stats_reset(dev);
+    pthread_mutex_unlock(&dev->lock);
+    return ret;
+}
+
+int dev_flush(struct ddriver *dev) {
+    if (dev->map != NULL) {
+        return msync(dev->map, dev->layout_size, MS_SYNC);
+    }
+    return fsync(dev->fd);
+}
+
+int stripe_map(struct ddriver *dev, off_t offset, off_t *member_ofs) {
+    long long unit = offset / dev->stripe_sz;
+
+    *member_ofs = unit / dev->nr_members * dev->stripe_sz + offset % dev->stripe_sz;
+    return unit % dev->nr_members;
+}
+
+void stripe_part_io(struct stripe_part *part) {
+    unsigned long long clock = STAT_GET(part->member, elapsed_us);
+
+    part->res = emulate_io(part->member, part->op, part->iov, part->iovcnt, 
+                           part->offset, part->size);
+    part->lat = STAT_GET(part->member, elapsed_us) - clock;
+}
+
+void* stripe_worker(void *arg) {
+    struct stripe_worker *worker = arg;
+    struct ddriver *dev = worker->dev;
+    struct stripe_part *part;
+
+    pthread_mutex_lock(&dev->stripe_lock);
+    while (1) {
+        while (worker->running && worker->head == NULL) {
+            pthread_cond_wait(&worker->cond, &dev->stripe_lock);
+        }
+        if (worker->head == NULL) {                   /* Stopped and drained */
+            break;
+        }
+        part = worker->head;
+        worker->head = part->next;
+        pthread_mutex_unlock(&dev->stripe_lock);
+        stripe_part_io(part);
+        pthread_mutex_lock(&dev->stripe_lock);
+        part->done = 1;
+        pthread_cond_broadcast(&dev->stripe_done);
+    }
+    pthread_mutex_unlock(&dev->stripe_lock);
+    return NULL;
+}
+
+void stripe_queue(struct stripe_worker *worker, struct stripe_part *part) {
+    part->next = NULL;                                /* Caller holds stripe_lock */
+    part->done = 0;
+    if (worker->head == NULL)
+        worker->head = part;
+    else
+        worker->tail->next = part;
+    worker->tail = part;
+    pthread_cond_signal(&worker->cond);
+}
+
+void stripe_stop(struct ddriver *dev) {
+    int m;
+
+    pthread_mutex_lock(&dev->stripe_lock);
+    for (m = 0; m < dev->nr_members; m++) {
+        dev->stripe_workers[m].running = 0;
+        pthread_cond_signal(&dev->stripe_workers[m].cond);
+    }
+    pthread_mutex_unlock(&dev->stripe_lock);
+    for (m = 0; m < dev->nr_members; m++) {
+        if (dev->stripe_workers[m].thread != 0) {
+            pthread_join(dev->stripe_workers[m].thread, NULL);
+            dev->stripe_workers[m].thread = 0;
+        }
+    }
+}
+
+int stripe_start(struct ddriver *dev) {
+    int m, ret;
+
+    for (m = 0; m < dev->nr_members; m++) {          /* Live as long as the device */
+        dev->stripe_workers[m].running = 1;
+        ret = pthread_create(&dev->stripe_workers[m].thread, NULL, stripe_worker, 
+                             &dev->stripe_workers[m]);
+        if (ret != 0) {
+            user_panic("can't start stripe worker: %s", strerror(ret));
+            dev->stripe_workers[m].running = 0;
+            dev->stripe_workers[m].thread = 0;
+            stripe_stop(dev);
+            return -ret;
+        }
+    }
+    return 0;
+}
+
+int stripe_io(struct ddriver *dev, int op, const struct iovec *iov, int iovcnt, off_t offset, size_t size) {
+    struct stripe_part parts[CONFIG_STRIPE_MAX];
+    struct stripe_part *part;
+    struct iovec *pool;
+    int i = 0, m, first = -1, res = size;
+    size_t done = 0, in = 0, chunk, n;
+    long long lat = 0;
+    off_t ofs;
+
+    /* Each member sees one contiguous range: its chunks of consecutive rows */
+    n = iovcnt + size / dev->stripe_sz + 1;           /* Pieces any member may need */
+    pool = malloc(sizeof(struct iovec) * n * dev->nr_members);
+    if (pool == NULL)
+        return -ENOMEM;
+    memset(parts, 0, sizeof(parts));
+    for (m = 0; m < dev->nr_members; m++) {
+        parts[m].member = dev->members[m];
+        parts[m].op = op;
+        parts[m].iov = pool + m * n;
+    }
+    while (done < size) {
+        ofs = offset + done;
+        chunk = dev->stripe_sz - ofs % dev->stripe_sz;
+        if (chunk > size - done)
+            chunk = size - done;
+        m = stripe_map(dev, ofs, &ofs);
+        part = &parts[m];
+        if (part->size == 0)
+            part->offset = ofs;
+        while (chunk > 0) {                           /* Split on caller iov boundaries too */
+            n = iov[i].iov_len - in < chunk ? iov[i].iov_len - in : chunk;
+            part->iov[part->iovcnt].iov_base = (char *)iov[i].iov_base + in;
+            part->iov[part->iovcnt].iov_len = n;
+            part->iovcnt++;
+            part->size += n;
+            chunk -= n;
+            done += n;
+            in += n;
+            if (in == iov[i].iov_len) {
+                i++;
+                in = 0;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&dev->stripe_lock);            /* Members overlap their latency */
+    for (m = 0; m < dev->nr_members; m++) {
+        if (parts[m].size == 0)
+            continue;
+        if (first < 0) {
+            first = m;                                /* Run by the caller */
+            continue;
+        }
+        stripe_queue(&dev->stripe_workers[m], &parts[m]);
+    }
+    pthread_mutex_unlock(&dev->stripe_lock);
+    stripe_part_io(&parts[first]);
+    pthread_mutex_lock(&dev->stripe_lock);
+    for (m = 0; m < dev->nr_members; m++) {
+        while (m != first && parts[m].size != 0 && !parts[m].done)
+            pthread_cond_wait(&dev->stripe_done, &dev->stripe_lock);
+    }
+    pthread_mutex_unlock(&dev->stripe_lock);
+    for (m = 0; m < dev->nr_members; m++) {
+        if (parts[m].size == 0)
+            continue;
+        if (parts[m].res < 0)
+            res = parts[m].res;
+        if (parts[m].lat > lat)
+            lat = parts[m].lat;
+    }
+    free(pool);
+
+    pthread_mutex_lock(&dev->lock);                   /* Slowest member is the request cost */
+    STAT_ADD(dev, elapsed_us, lat);
+    if (res >= 0)
+        account_io(dev, op, offset, size, lat);
+    pthread_mutex_unlock(&dev->lock);
+    return res;
+}
+
+int stripe_discard(struct ddriver *dev, off_t offset, off_t len) {
+    off_t end = offset + len, member_ofs, chunk;
+    int m, ret;
+
+    for (; offset < end; offset += chunk) {
+        chunk = dev->stripe_sz - offset % dev->stripe_sz;
+        if (chunk > end - offset)
+            chunk = end - offset;
+        m = stripe_map(dev, offset, &member_ofs);
+        ret = emulate_discard(dev->members[m], member_ofs, chunk);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+int stripe_ioctl(struct ddriver *dev, unsigned long cmd, void *arg) {
+    struct ddriver_range range;
+    struct ddriver_latency lat;
+    int m, ret = 0;
+
+    switch (cmd)
+    {
+    case IOC_REQ_DEVICE_DISCARD:
+        memcpy(&range, arg, sizeof(struct ddriver_range));
+        ret = check_valid_range(dev, range.offset, range.len);
+        if (ret < 0)
+            return ret;
+        trace_record(dev, DDRIVER_TRACE_DISCARD, range.offset, range.len);
+        return stripe_discard(dev, range.offset, range.len);
+    case IOC_REQ_DEVICE_RESET:
+        for (m = 0; m < dev->nr_members; m++) {
+            if (emulate_reset(dev->members[m]) < 0)
+                ret = -EIO;
+        }
+        pthread_mutex_lock(&dev->lock);
+        SET_HEAD(dev, 0);
+        SET_CURSOR(dev, 0);
+        stats_reset(dev);
+        pthread_mutex_unlock(&dev->lock);
+        return ret;
+    case IOC_REQ_DEVICE_FLUSH:
+        for (m = 0; m < dev->nr_members; m++) {
+            if (dev_flush(dev->members[m]) < 0)
+                ret = -EIO;
+        }
+        return ret;
+    case IOC_REQ_DEVICE_GET_LAT:                      /* Members share one latency model */
+        lat.read_lat  = dev->members[0]->read_lat;
+        lat.write_lat = dev->members[0]->write_lat;
+        lat.seek_lat  = dev->members[0]->seek_lat;
+        lat.track_num = dev->members[0]->track_num;
+        memcpy(arg, &lat, sizeof(struct ddriver_latency));
+        return 0;
+    case IOC_REQ_DEVICE_PROFILE:
+    case IOC_REQ_DEVICE_SET_LAT:
+    case IOC_REQ_DEVICE_SET_DIST:
+        for (m = 0; m < dev->nr_members && ret == 0; m++) {
+            if (cmd == IOC_REQ_DEVICE_PROFILE)
+                ret = set_profile(dev->members[m], *(int *)arg);
+            else if (cmd == IOC_REQ_DEVICE_SET_LAT)
+                ret = set_latency(dev->members[m], (struct ddriver_latency *)arg);
+            else
+                ret = set_dist(dev->members[m], (struct ddriver_lat_dist *)arg);
+        }
+        return ret;
+    default:                                          /* Served by the striped device itself */
+        return -ENOTTY;
+    }
+}
+
+int sched_pick(struct ddriver *dev) {
+    int i, pick = -1;
+    off_t head = __atomic_load_n(&dev->head, __ATOMIC_RELAXED);  /* Moved by workers meanwhile */
+
+    if (dev->ring.sched == DDRIVER_SCHED_NOOP) {
+        return 0;
+    }
+    for (i = 0; i < dev->ring.nr_pending; i++) {      /* Nearest in sweep direction */
+        off_t ofs = dev->ring.pending[i].offset;
+        if (dev->ring.sched == DDRIVER_SCHED_SCAN && !dev->ring.scan_up) {
+            if (ofs <= head && (pick < 0 || ofs > dev->ring.pending[pick].offset))
+                pick = i;
+        }
+        else if (ofs >= head && (pick < 0 || ofs < dev->ring.pending[pick].offset)) {
+            pick = i;
+        }
+    }
+    if (pick >= 0) {
+        return pick;
+    }
+    if (dev->ring.sched == DDRIVER_SCHED_SCAN) {      /* SCAN: reverse the sweep */
+        dev->ring.scan_up = !dev->ring.scan_up;
+        return sched_pick(dev);
+    }
+    for (i = 0; i < dev->ring.nr_pending; i++) {      /* C-LOOK: wrap to the lowest */
+        if (pick < 0 || dev->ring.pending[i].offset < dev->ring.pending[pick].offset)
+            pick = i;
+    }
+    return pick;
+}
+
+void sched_remove(struct ddriver *dev, int idx, struct ddriver_sqe *sqe) {
+    *sqe = dev->ring.pending[idx];
+    dev->ring.nr_pending--;
+    memmove(&dev->ring.pending[idx], &dev->ring.pending[idx + 1], 
+            (dev->ring.nr_pending - idx) * sizeof(struct ddriver_sqe));
+}
 
-#define INC_READCNT(disk)       (disk.read_cnt++)
-#define INC_WRITECNT(disk)      (disk.write_cnt++)
-#define INC_SEEKCNT(disk)       (disk.seek_cnt++)
+int sched_mergeable(struct ddriver *dev, struct ddriver_sqe *sqe) {
+    return IS_ADDR_ALIGN(dev, sqe->offset) && IS_SIZE_ALIGN(dev, sqe->size) &&
+           sqe->offset >= 0 && sqe->offset + (off_t)sqe->size <= dev->layout_size;
+}
 
-#define RW_DELAY(disk, rw_ops)  (usleep(disk.rw_ops##_lat * 1000))
-/******************************************************************************
-* SECTION: Type definitions
-*******************************************************************************/
-struct ddriver
-{
-    int  ddriver_fd;                                 /* Disk ddriver_fd */
-    int  read_cnt;
-    int  write_cnt;
-    int  seek_cnt;
-    int  read_lat;
-    int  write_lat;
-    int  seek_lat;
-    int  track_num;
-    int  major_num;
-    int  layout_size;
-    int  iounit_size;
-};
-/******************************************************************************
-* SECTION: Global Variable
-*******************************************************************************/
-/* reference: https://en.wikipedia.org/wiki/Hard_disk_drive_performance_characteristics */
-struct ddriver disk = {
-    .read_cnt    = 0,
-    .write_cnt   = 0,
-    .seek_cnt    = 0,
-    .read_lat    = 2,       /* 2ms */       
-    .write_lat   = 1,       /* 1ms */
-    .seek_lat    = 4,       /* 4.17ms per 360 degree */
-    .major_num   = 0,
-    .track_num   = 100,
-    .layout_size = CONFIG_DISK_SZ,
-    .iounit_size = CONFIG_BLOCK_SZ
-};
+int sched_dispatch(struct ddriver *dev, struct ddriver_sqe *batch) {
+    int i, nr = 1;
+    int op;
+    off_t lo, hi;
 
-FILE *debugf = NULL;
-/******************************************************************************
-* SECTION: Helper Functions
-*******************************************************************************/
-int check_valid(size_t size) {
-    if (size != CONFIG_BLOCK_SZ){
-        user_alert("io size %ld should align to %d", size, CONFIG_BLOCK_SZ);
-        return -EIO;
+    sched_remove(dev, sched_pick(dev), &batch[0]);
+    op = batch[0].op;
+    if (op != DDRIVER_OP_READ && op != DDRIVER_OP_WRITE) {
+        return nr;
+    }
+    if (!sched_mergeable(dev, &batch[0])) {
+        return nr;                                    /* Fails on its own */
+    }
+    lo = batch[0].offset;
+    hi = batch[0].offset + batch[0].size;
+    for (i = 0; i < dev->ring.nr_pending && nr < CONFIG_MERGE_MAX; i++) {
+        struct ddriver_sqe *sqe = &dev->ring.pending[i]; /* Merge adjacent sectors */
+        if (sqe->op != op || !sched_mergeable(dev, sqe)) {
+            continue;                                 /* Never fails a valid neighbour */
+        }
+        if (sqe->offset == hi) {
+            hi += sqe->size;
+            sched_remove(dev, i, &batch[nr++]);
+            i = -1;                                   /* Rescan for the new ends */
+        }
+        else if (sqe->offset + (off_t)sqe->size == lo) {
+            memmove(&batch[1], &batch[0], nr * sizeof(struct ddriver_sqe));
+            lo = sqe->offset;
+            sched_remove(dev, i, &batch[0]);
+            nr++;
+            i = -1;
+        }
+    }
+    return nr;
+}
+
+void* ring_worker(void *arg) {
+    struct ddriver_sqe batch[CONFIG_MERGE_MAX];
+    struct iovec iov[CONFIG_MERGE_MAX];
+    struct ddriver_cqe cqe;
+    size_t total;
+    int i, nr, res;
+    struct ddriver *dev = arg;
+
+    pthread_mutex_lock(&dev->ring.lock);
+    while (1) {
+        while (dev->ring.running && (dev->ring.nr_pending == 0 || dev->ring.busy >= RING_SLOTS(dev))) {
+            pthread_cond_wait(&dev->ring.sq_cond, &dev->ring.lock);
+        }
+        if (dev->ring.nr_pending == 0) {              /* Stopped and drained */
+            break;
+        }
+        if (dev->ring.busy >= RING_SLOTS(dev)) {
+            pthread_cond_wait(&dev->ring.sq_cond, &dev->ring.lock);
+            continue;
+        }
+        dev->ring.busy++;                             /* Pick while a queue is ours */
+        nr = sched_dispatch(dev, batch);
+        pthread_mutex_unlock(&dev->ring.lock);
+                                                      /* Emulated latency is paid here, 
+                                                         off the submitter's thread */
+        total = 0;
+        for (i = 0; i < nr; i++) {
+            iov[i].iov_base = batch[i].buf;
+            iov[i].iov_len  = batch[i].size;
+            total += batch[i].size;
+        }
+        if (batch[0].op == DDRIVER_OP_WRITE || batch[0].op == DDRIVER_OP_READ) {
+            res = emulate_io(dev, batch[0].op, iov, nr, batch[0].offset, total);
+        }
+        else {
+            res = -EINVAL;
+        }
+
+        pthread_mutex_lock(&dev->ring.lock);
+        dev->ring.busy--;
+        for (i = 0; i < nr; i++) {
+            cqe.user_data = batch[i].user_data;
+            cqe.res = res < 0 ? res : (int)batch[i].size;
+            dev->ring.cq[dev->ring.cq_tail++ % CONFIG_RING_SZ] = cqe;
+        }
+        pthread_cond_broadcast(&dev->ring.sq_cond);
+        pthread_cond_broadcast(&dev->ring.cq_cond);
+    }
+    pthread_mutex_unlock(&dev->ring.lock);
+    return NULL;
+}
+
+int ring_start(struct ddriver *dev) {
+    int i, ret;
+
+    dev->ring.nr_pending = 0;
+    dev->ring.busy = 0;
+    dev->ring.cq_head = dev->ring.cq_tail = 0;
+    dev->ring.inflight = 0;
+    dev->ring.running = 1;
+    dev->ring.nr_workers = dev->nr_queues > CONFIG_RING_WORKERS ? dev->nr_queues : CONFIG_RING_WORKERS;
+    for (i = 0; i < dev->ring.nr_workers; i++) {
+        ret = pthread_create(&dev->ring.workers[i], NULL, ring_worker, dev);
+        if (ret != 0) {
+            user_panic("can't start ring worker: %s", strerror(ret));
+            dev->ring.running = 0;
+            pthread_cond_broadcast(&dev->ring.sq_cond);
+            pthread_mutex_unlock(&dev->ring.lock);
+            while (i-- > 0) {
+                pthread_join(dev->ring.workers[i], NULL);
+            }
+            pthread_mutex_lock(&dev->ring.lock);
+            return -ret;
+        }
     }
     return 0;
 }
 
-int emulate_rotate(int fd, off_t start, off_t end) {
-    int bytes_per_track = disk.layout_size / disk.track_num;
-    int lat_per_track = disk.seek_lat;
-    int distance = abs(end - start) % bytes_per_track; 
-    
-    if (distance == 0) {
-        return 0;
+void ring_stop(struct ddriver *dev) {
+    int i;
+
+    pthread_mutex_lock(&dev->ring.lock);
+    if (!dev->ring.running) {
+        pthread_mutex_unlock(&dev->ring.lock);
+        return;
+    }
+    dev->ring.running = 0;
+    pthread_cond_broadcast(&dev->ring.sq_cond);
+    pthread_mutex_unlock(&dev->ring.lock);
+    for (i = 0; i < dev->ring.nr_workers; i++) {
+        pthread_join(dev->ring.workers[i], NULL);
+    }
+}
+
+int dev_free(struct ddriver *dev) {
+    int i, ret;
+
+    ring_stop(dev);                                   /* Its workers may still stripe */
+    stripe_stop(dev);
+    for (i = 0; i < dev->nr_members; i++) {
+        dev_free(dev->members[i]);
+    }
+    if (dev->map != NULL) {
+        munmap(dev->map, dev->layout_size);
+    }
+    if (dev->log != NULL) {
+        fclose(dev->log);
+    }
+    if (dev->trace != NULL) {
+        fclose(dev->trace);
+    }
+    if (dev->stats != &dev->local_stats) {
+        dev->stats->pid = 0;
+        munmap(dev->stats, sizeof(struct ddriver_live_stats));
+    }
+    free(dev->written);
+    free(dev->bounce);
+    if (dev->cow_map != NULL) {
+        munmap(dev->cow_map, dev->cow_map_sz);
+    }
+    if (dev->base_fd >= 0) {
+        close(dev->base_fd);
     }
+    ret = close(dev->fd);
+    pthread_mutex_destroy(&dev->lock);
+    pthread_mutex_destroy(&dev->ring.lock);
+    for (i = 0; i < CONFIG_MAX_QUEUES; i++) {
+        pthread_mutex_destroy(&dev->queues[i].lock);
+    }
+    for (i = 0; i < CONFIG_STRIPE_MAX; i++) {
+        pthread_cond_destroy(&dev->stripe_workers[i].cond);
+    }
+    pthread_mutex_destroy(&dev->stripe_lock);
+    pthread_cond_destroy(&dev->stripe_done);
+    pthread_cond_destroy(&dev->ring.sq_cond);
+    pthread_cond_destroy(&dev->ring.cq_cond);
+    free(dev);
+    return ret;
+}
+int cow_open(struct ddriver *dev, char *path) {
+    char map_path[PATH_MAX] = {0};
+    struct stat st;
+    int fd;
 
-    usleep(distance * lat_per_track / bytes_per_track * 1000);
+    if (fstat(dev->base_fd, &st) < 0 || st.st_size < dev->layout_size) {
+        user_panic("base image smaller than device size %lld", dev->layout_size);
+        return -EINVAL;
+    }
+    snprintf(map_path, sizeof(map_path), "%s" DEVICE_COW, path);
+    fd = open(map_path, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        user_panic("can't open block map %s: %s", map_path, strerror(errno));
+        return -errno;
+    }
+    dev->cow_map_sz = (dev->layout_size / dev->iounit_size + 7) / 8;
+    if (ftruncate(fd, dev->cow_map_sz) < 0) {         /* Zero filled when first created */
+        close(fd);
+        return -errno;
+    }
+    dev->cow_map = mmap(NULL, dev->cow_map_sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (dev->cow_map == MAP_FAILED) {
+        user_panic("can't map block map: %s", strerror(errno));
+        dev->cow_map = NULL;
+        return -errno;
+    }
     return 0;
 }
+
+int dev_open(char *path, struct ddriver_config *config, struct ddriver **out) {
+    int fd, direct, ret = 0;
+    long long disk_size;
+    char log_path[PATH_MAX] = {0};
+    struct ddriver_config env_config;
+    struct ddriver *dev;
+    struct stat st;
+
+    if (config == NULL) {
+        config_from_env(&env_config);
+        config = &env_config;
+    }
+
+    if ((config->flags & DDRIVER_FLAG_DIRECT) && (config->flags & DDRIVER_FLAG_MMAP)) {
+        user_panic("direct mode can't be mapped");
+        return -EINVAL;
+    }
+    direct = config->flags & DDRIVER_FLAG_DIRECT ? O_DIRECT : 0;
+    fd = open(path, O_CREAT | O_RDWR | direct, 0644);
+    if (fd < 0) {
+        user_panic("can't open device %s: %s", path, strerror(errno));
+        return fd;
+    }
+    if (fd >= CONFIG_MAX_DEVS) {
+        user_panic("too many open devices");
+        close(fd);
+        return -EMFILE;
+    }
+    dev = dev_alloc(fd);
+    if (dev == NULL) {
+        close(fd);
+        return -ENOMEM;
+    }
+
+    dev->vclock = (config->flags & DDRIVER_FLAG_VCLOCK) != 0;
+    dev->direct = direct != 0;
+    disk_size = config->disk_size;
+    if (config->base != NULL) {                       /* path is a copy-on-write overlay */
+        if (config->flags & DDRIVER_FLAG_MMAP) {
+            user_panic("overlay images can't be mapped");
+            dev_free(dev);
+            return -EINVAL;
+        }
+        dev->base_fd = open(config->base, O_RDONLY | direct);
+        if (dev->base_fd < 0) {
+            user_panic("can't open base %s: %s", config->base, strerror(errno));
+            dev_free(dev);
+            return -1;
+        }
+        if (disk_size == 0 && fstat(dev->base_fd, &st) == 0) {
+            disk_size = st.st_size;                   /* Same size as the base by default */
+        }
+    }
+    if (set_geometry(dev, disk_size, config->iounit_size) < 0) {
+        dev_free(dev);
+        return -EINVAL;
+    }
+    if (set_profile(dev, config->profile) < 0) {
+        dev_free(dev);
+        return -EINVAL;
+    }
+    if (fstat(fd, &st) < 0) {
+        user_panic("can't stat device: %s", strerror(errno));
+        dev_free(dev);
+        return -1;
+    }
+    if (st.st_size < dev->layout_size) {              /* Sparse, blocks allocated on first write */
+        ret = ftruncate(fd, dev->layout_size);
+        if (ret < 0) {
+            user_panic("can't extend device to %lld: %s", dev->layout_size, strerror(errno));
+            dev_free(dev);
+            return ret;
+        }
+    }
+    if (config->dist.type != DDRIVER_DIST_FIXED && set_dist(dev, &config->dist) < 0) {
+        dev_free(dev);
+        return -EINVAL;
+    }
+    dev->rand_state = config->seed ? config->seed : CONFIG_RAND_SEED;
+    if (set_queues(dev, config->nr_queues) < 0) {
+        dev_free(dev);
+        return -EINVAL;
+    }
+    if (set_sched(dev, config->sched) < 0) {
+        dev_free(dev);
+        return -EINVAL;
+    }
+
+    if (dev->base_fd >= 0) {
+        ret = cow_open(dev, path);
+        if (ret < 0) {
+            dev_free(dev);
+            return ret;
+        }
+    }
+    extent_init(dev);
+
+    if (config->flags & DDRIVER_FLAG_MMAP) {
+        dev->map = mmap(NULL, dev->layout_size, PROT_READ | PROT_WRITE, 
+                        MAP_SHARED, fd, 0);
+        if (dev->map == MAP_FAILED) {
+            user_panic("can't map device: %s", strerror(errno));
+            dev->map = NULL;
+            dev_free(dev);
+            return -1;
+        }
+    }
+
+    snprintf(log_path, sizeof(log_path), "%s" DEVICE_LOG, path);
+    dev->log = fopen(log_path, "w+");
+    if (dev->log == NULL) {
+        user_panic("can't init log: %s", log_path);
+        dev_free(dev);
+        return -1;
+    }
+    if (config->trace != NULL && trace_open(dev, config->trace) < 0) {
+        dev_free(dev);
+        return -1;
+    }
+    stats_open(dev, path);
+
+    *out = dev;
+    return fd;
+}
 /******************************************************************************
 * SECTION: Global Function Implementation
 *******************************************************************************/
 /**
- * @brief 打开驱动
+ * @brief 按配置打开驱动
  * 
+ * @param path 设备映像路径，不存在时创建，日志写在同目录的<path>_log，
+ *             实时计数映射在<path>_stats，可用ddriver -s查看
+ * @param config 打开选项，为NULL时从环境变量读取；指定base时path作为其写时复制的
+ *               覆盖层，块映射保存在<path>_cow，IOC_REQ_DEVICE_RESET即恢复为base
  * @return int 文件描述符
  */
-int ddriver_open(char *path) {
-    int fd, ret = 0;
-    char device_path[128] = {0};
-    char log_path[128] = {0};
-    
-    sprintf(device_path, "%s/" DEVICE_NAME, getpwuid(getuid())->pw_dir);
-    sprintf(log_path, "%s/" DEVICE_LOG, getpwuid(getuid())->pw_dir);
-    
-    if (strcmp(device_path, path) != 0) {
-        user_panic("wrong path [%s], should be [%s]", path, device_path);
-        return -1;
-    }
+int ddriver_open_config(char *path, struct ddriver_config *config) {
+    struct ddriver *dev;
+    int fd = dev_open(path, config, &dev);
+
+    if (fd < 0)
+        return fd;
+    pthread_mutex_lock(&devices_lock);
+    devices[fd] = dev;
+    pthread_mutex_unlock(&devices_lock);
+    return fd;
+}
+/**
+ * @brief 将多个设备映像条带化(RAID-0)为一个逻辑设备，跨成员的请求并行下发，
+ *        各成员的模拟延迟相互重叠
+ * 
+ * @param paths 成员映像路径，按同一配置打开
+ * @param nr 成员数，不超过CONFIG_STRIPE_MAX
+ * @param stripe_sz 条带单元字节数，必须是IO单位的整数倍
+ * @param config 打开选项，为NULL时从环境变量读取；disk_size为单个成员的大小
+ * @return int 文件描述符，关闭时一并关闭各成员；实时计数在<paths[0]>_stripe_stats
+ */
+int ddriver_open_stripe(char **paths, int nr, int stripe_sz, struct ddriver_config *config) {
+    struct ddriver *members[CONFIG_STRIPE_MAX];
+    struct ddriver_config member_config;
+    struct ddriver *dev;
+    long long member_sz;
+    char stats_path[PATH_MAX] = {0};
+    char *trace;
+    int i, fd;
 
-    if (access(device_path, F_OK) == 0) {
-        fd = open(device_path, O_RDWR);
+    if (nr <= 0 || nr > CONFIG_STRIPE_MAX) {
+        user_panic("stripe needs 1 to %d members", CONFIG_STRIPE_MAX);
+        return -EINVAL;
+    }
+    if (config == NULL) {
+        config_from_env(&member_config);
     }
     else {
-        fd = open(device_path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+        member_config = *config;
     }
-    if (fd < 0) {
-        user_panic("can't open device: %d", fd);
-        return fd;
+    if (member_config.base != NULL) {
+        user_panic("stripe members can't be overlays");
+        return -EINVAL;
     }
-    ret = posix_fallocate(fd, 0, CONFIG_DISK_SZ);
-    if (ret < 0) {
-        user_panic("low space");
-        return ret;
+    trace = member_config.trace;                      /* Traced as one logical device */
+    member_config.trace = NULL;
+    if (member_config.seed == 0) {
+        member_config.seed = CONFIG_RAND_SEED;
+    }
+    for (i = 0; i < nr; i++) {
+        fd = dev_open(paths[i], &member_config, &members[i]);
+        if (fd < 0) {
+            while (i-- > 0)
+                dev_free(members[i]);
+            return fd;
+        }
+        member_config.seed++;                         /* Members sample independently */
     }
 
-    debugf = fopen(log_path, "w+");
-    if (debugf == NULL) {
-        user_panic("can't init log: %s", log_path);
+    member_sz = members[0]->layout_size;
+    if (stripe_sz <= 0 || stripe_sz % members[0]->iounit_size != 0 || stripe_sz > member_sz) {
+        user_panic("stripe unit %d should be a multiple of io unit %d within %lld", 
+                   stripe_sz, members[0]->iounit_size, member_sz);
+        fd = -EINVAL;
+    }
+    else {
+        fd = dup(members[0]->fd);                     /* Handle of the striped device */
+    }
+    if (fd >= CONFIG_MAX_DEVS) {
+        user_panic("too many open devices");
+        close(fd);
+        fd = -EMFILE;
+    }
+    dev = fd < 0 ? NULL : dev_alloc(fd);
+    if (dev == NULL) {
+        if (fd >= 0)
+            close(fd);
+        for (i = 0; i < nr; i++)
+            dev_free(members[i]);
+        return fd < 0 ? fd : -ENOMEM;
+    }
+    memcpy(dev->members, members, sizeof(struct ddriver *) * nr);
+    dev->nr_members  = nr;
+    dev->stripe_sz   = stripe_sz;
+    dev->iounit_size = members[0]->iounit_size;
+    dev->layout_size = member_sz / stripe_sz * stripe_sz * nr;
+    dev->vclock      = members[0]->vclock;
+    set_profile(dev, DDRIVER_PROFILE_ZERO);           /* Cost is paid by the members */
+    set_sched(dev, member_config.sched);
+    if (stripe_start(dev) < 0) {
+        dev_free(dev);
+        return -EAGAIN;
+    }
+    if (trace != NULL && trace_open(dev, trace) < 0) {
+        dev_free(dev);
         return -1;
     }
+    snprintf(stats_path, sizeof(stats_path), "%s_stripe", paths[0]);
+    stats_open(dev, stats_path);
 
+    pthread_mutex_lock(&devices_lock);
+    devices[fd] = dev;
+    pthread_mutex_unlock(&devices_lock);
     return fd;
 }
+/**
+ * @brief 打开驱动
+ * 
+ * @return int 文件描述符
+ */
+int ddriver_open(char *path) {
+    return ddriver_open_config(path, NULL);
+}
 /**
  * @brief 关闭驱动
  * 
@@ -168,7 +1928,14 @@ int ddriver_open(char *path) {
  * @return int 
  */
 int ddriver_close(int fd) {
-    return close(fd) && fclose(debugf);
+    struct ddriver *dev = dev_get(fd);
+
+    if (dev == NULL)
+        return -EBADF;
+    pthread_mutex_lock(&devices_lock);
+    devices[fd] = NULL;
+    pthread_mutex_unlock(&devices_lock);
+    return dev_free(dev);
 }
 /**
  * @brief 磁盘头SEEK
@@ -179,23 +1946,50 @@ int ddriver_close(int fd) {
  * @return int 
  */
 int ddriver_seek(int fd, off_t offset, int whence){
-    int ret = 0;
-    int cur = 0;
+    struct ddriver *dev = dev_get(fd);
+    off_t cur;
+    off_t ret;
 
-    if (!IS_ADDR_ALIGN(offset)) {
-        user_alert("offset %ld must be aligned to block size %d", 
-                      offset, CONFIG_BLOCK_SZ);
+    if (dev == NULL)
+        return -EBADF;
+    pthread_mutex_lock(&dev->lock);
+    cur = dev->cursor;
+    if (!IS_ADDR_ALIGN(dev, offset)) {
+        pthread_mutex_unlock(&dev->lock);
+        user_alert(dev, "offset %ld must be aligned to block size %d", 
+                      offset, dev->iounit_size);
         return -EINVAL;
     }
 
-    INC_SEEKCNT(disk);
-    cur = lseek(fd, 0, SEEK_CUR);
-    ret = lseek(fd, offset, whence);
+    switch (whence)
+    {
+    case SEEK_SET:
+        ret = offset;
+        break;
+    case SEEK_CUR:
+        ret = cur + offset;
+        break;
+    case SEEK_END:
+        ret = dev->layout_size + offset;
+        break;
+    default:
+        ret = -1;
+        break;
+    }
     if (ret < 0) {
-        user_panic("seek error: %s", strerror(errno));
-        return ret;
+        pthread_mutex_unlock(&dev->lock);
+        user_panic("seek error: %s", strerror(EINVAL));
+        return -EINVAL;
+    }
+
+    trace_record(dev, DDRIVER_TRACE_SEEK, ret, 0);
+    if (dev->nr_queues == 0) {                        /* No head to move with queues */
+        account_seek(dev, dev->head, ret);
+        emulate_rotate(dev, dev->head, ret);
     }
-    emulate_rotate(fd, cur, ret);
+    SET_HEAD(dev, ret);
+    SET_CURSOR(dev, ret);
+    pthread_mutex_unlock(&dev->lock);
     return ret;
 }
 /**
@@ -207,15 +2001,20 @@ int ddriver_seek(int fd, off_t offset, int whence){
  * @return int 
  */
 int ddriver_write(int fd, char *buf, size_t size){
-    int res = check_valid(size);
+    struct ddriver *dev = dev_get(fd);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    int res;
+
+    if (dev == NULL)
+        return -EBADF;
+    res = check_valid(dev, size);
     if(res < 0)
         return res;
-        
-    RW_DELAY(disk, write);
-    write(fd, buf, size);
 
-    INC_WRITECNT(disk);
-    return CONFIG_BLOCK_SZ;
+    res = cursor_io(dev, DDRIVER_OP_WRITE, &iov, 1, size);
+    if (res < 0)
+        return res;
+    return dev->iounit_size;
 }
 /**
  * @brief 
@@ -226,15 +2025,254 @@ int ddriver_write(int fd, char *buf, size_t size){
  * @return int 
  */
 int ddriver_read(int fd, char *buf, size_t size){
-    int res = check_valid(size);
+    struct ddriver *dev = dev_get(fd);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    int res;
+
+    if (dev == NULL)
+        return -EBADF;
+    res = check_valid(dev, size);
+    if(res < 0)
+        return res;
+
+    res = cursor_io(dev, DDRIVER_OP_READ, &iov, 1, size);
+    if (res < 0)
+        return res;
+    return dev->iounit_size;
+}
+/**
+ * @brief 连续多扇区写入，整段只计一次访问延迟
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 必须是块大小的整数倍
+ * @return int 写入字节数
+ */
+int ddriver_write_blocks(int fd, char *buf, size_t size){
+    struct ddriver *dev = dev_get(fd);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+
+    if (dev == NULL)
+        return -EBADF;
+    return cursor_io(dev, DDRIVER_OP_WRITE, &iov, 1, size);
+}
+/**
+ * @brief 连续多扇区读出，整段只计一次访问延迟
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 必须是块大小的整数倍
+ * @return int 读出字节数
+ */
+int ddriver_read_blocks(int fd, char *buf, size_t size){
+    struct ddriver *dev = dev_get(fd);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+
+    if (dev == NULL)
+        return -EBADF;
+    return cursor_io(dev, DDRIVER_OP_READ, &iov, 1, size);
+}
+/**
+ * @brief 向量写入，从当前读写位置起连续写入各段，整体只计一次访问延迟
+ * 
+ * @param fd 
+ * @param iov 每段长度必须是块大小的整数倍
+ * @param iovcnt 
+ * @return int 写入字节数
+ */
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt){
+    struct ddriver *dev = dev_get(fd);
+    size_t total;
+    int res;
+
+    if (dev == NULL)
+        return -EBADF;
+    res = check_valid_iov(dev, iov, iovcnt, &total);
+    if(res < 0)
+        return res;
+
+    return cursor_io(dev, DDRIVER_OP_WRITE, iov, iovcnt, total);
+}
+/**
+ * @brief 向量读出，从当前读写位置起连续读入各段，整体只计一次访问延迟
+ * 
+ * @param fd 
+ * @param iov 每段长度必须是块大小的整数倍
+ * @param iovcnt 
+ * @return int 读出字节数
+ */
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt){
+    struct ddriver *dev = dev_get(fd);
+    size_t total;
+    int res;
+
+    if (dev == NULL)
+        return -EBADF;
+    res = check_valid_iov(dev, iov, iovcnt, &total);
     if(res < 0)
         return res;
 
-    RW_DELAY(disk, read);
-    read(fd, buf, size);
+    return cursor_io(dev, DDRIVER_OP_READ, iov, iovcnt, total);
+}
+/**
+ * @brief 定位写入，不移动seek、read、write共用的读写位置，磁盘头仅用于延迟模拟
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 必须是块大小的整数倍
+ * @param offset 必须按块对齐
+ * @return int 写入字节数
+ */
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset){
+    struct ddriver *dev = dev_get(fd);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+
+    if (dev == NULL)
+        return -EBADF;
+    return emulate_io(dev, DDRIVER_OP_WRITE, &iov, 1, offset, size);
+}
+/**
+ * @brief 定位读出，不移动seek、read、write共用的读写位置，磁盘头仅用于延迟模拟
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 必须是块大小的整数倍
+ * @param offset 必须按块对齐
+ * @return int 读出字节数
+ */
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset){
+    struct ddriver *dev = dev_get(fd);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+
+    if (dev == NULL)
+        return -EBADF;
+    return emulate_io(dev, DDRIVER_OP_READ, &iov, 1, offset, size);
+}
+/**
+ * @brief 映射模式下直接返回块在设备映像中的地址，免去一次拷贝
+ * 
+ * @param fd 
+ * @param blkno 块号，以IO单位计
+ * @return char* 块地址，经由该地址的修改通过IOC_REQ_DEVICE_FLUSH落盘；
+ *               非映射模式或越界时返回NULL
+ */
+char* ddriver_map_block(int fd, int blkno){
+    struct ddriver *dev = dev_get(fd);
+    off_t offset;
+
+    if (dev == NULL)
+        return NULL;
+    offset = (off_t)blkno * dev->iounit_size;
+    if (dev->map == NULL) {
+        user_alert(dev, "device is not opened in mmap mode");
+        return NULL;
+    }
+    if (check_valid_range(dev, offset, dev->iounit_size) < 0)
+        return NULL;
+
+    pthread_mutex_lock(&dev->lock);                   /* Faulting the block in costs one read */
+    emulate_access(dev, DDRIVER_OP_READ, offset, dev->iounit_size);
+    extent_mark(dev, offset, dev->iounit_size, 1);    /* May be written through the pointer */
+    pthread_mutex_unlock(&dev->lock);
+    return dev->map + offset;
+}
+/**
+ * @brief 异步提交一批读写请求，由后台worker执行并承担模拟延迟
+ * 
+ * @param fd 
+ * @param sqes 请求数组，buf在完成前必须保持有效
+ * @param nr 请求个数
+ * @return int 实际提交的个数，未完成请求达到上限时可能少于nr
+ */
+int ddriver_submit(int fd, struct ddriver_sqe *sqes, int nr){
+    struct ddriver *dev = dev_get(fd);
+    int i, ret;
+
+    if (dev == NULL)
+        return -EBADF;
+    if (nr < 0) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&dev->ring.lock);
+    if (!dev->ring.running) {
+        ret = ring_start(dev);
+        if (ret < 0) {
+            pthread_mutex_unlock(&dev->ring.lock);
+            return ret;
+        }
+    }
+    for (i = 0; i < nr && dev->ring.inflight < CONFIG_RING_SZ; i++) {
+        dev->ring.pending[dev->ring.nr_pending++] = sqes[i];
+        dev->ring.inflight++;
+    }
+    if (i > 0) {
+        pthread_cond_broadcast(&dev->ring.sq_cond);
+    }
+    pthread_mutex_unlock(&dev->ring.lock);
+    return i;
+}
+/**
+ * @brief 收割已完成的异步请求
+ * 
+ * @param fd 
+ * @param cqes 完成项数组
+ * @param min_nr 至少等待完成的个数，超过未完成总数时按未完成总数等待
+ * @param max_nr 最多收割的个数
+ * @return int 收割的个数
+ */
+int ddriver_poll_completions(int fd, struct ddriver_cqe *cqes, int min_nr, int max_nr){
+    struct ddriver *dev = dev_get(fd);
+    int nr = 0;
+
+    if (dev == NULL)
+        return -EBADF;
+    if (min_nr < 0 || max_nr < min_nr) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&dev->ring.lock);
+    if (min_nr > dev->ring.inflight) {
+        min_nr = dev->ring.inflight;
+    }
+    while (dev->ring.cq_tail - dev->ring.cq_head < (unsigned int)min_nr) {
+        pthread_cond_wait(&dev->ring.cq_cond, &dev->ring.lock);
+    }
+    while (nr < max_nr && dev->ring.cq_head != dev->ring.cq_tail) {
+        cqes[nr++] = dev->ring.cq[dev->ring.cq_head++ % CONFIG_RING_SZ];
+    }
+    dev->ring.inflight -= nr;
+    pthread_mutex_unlock(&dev->ring.lock);
+    return nr;
+}
+/**
+ * @brief 依次执行一批读写描述符，单个失败不影响其余描述符
+ * 
+ * @param dev 
+ * @param batch 每个描述符的status写回传输字节数或错误码，done写回成功个数
+ * @return int 0，或批次本身非法时返回错误码
+ */
+static int submit_batch(struct ddriver *dev, struct ddriver_batch *batch) {
+    struct ddriver_batch_desc *descs = (struct ddriver_batch_desc *)(uintptr_t)batch->descs;
+    struct iovec iov;
+    int i;
 
-    INC_READCNT(disk);
-    return CONFIG_BLOCK_SZ;
+    if (batch->nr < 0 || (batch->nr > 0 && descs == NULL))
+        return -EINVAL;
+    batch->done = 0;
+    for (i = 0; i < batch->nr; i++) {
+        iov.iov_base = (char *)(uintptr_t)descs[i].buf;
+        iov.iov_len  = descs[i].len;
+        if ((descs[i].op != DDRIVER_BATCH_READ && descs[i].op != DDRIVER_BATCH_WRITE)
+            || descs[i].len > INT_MAX) {
+            descs[i].status = -EINVAL;
+            continue;
+        }
+        descs[i].status = emulate_io(dev, descs[i].op, &iov, 1, descs[i].offset, descs[i].len);
+        if (descs[i].status >= 0)
+            batch->done++;
+    }
+    return 0;
 }
 /**
  * @brief 
@@ -245,32 +2283,82 @@ int ddriver_read(int fd, char *buf, size_t size){
  * @return int 
  */
 int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
+    struct ddriver *dev = dev_get(fd);
     struct ddriver_state state;
+    struct ddriver_latency lat;
+    struct ddriver_lat_report report;
+    struct ddriver_range range;
+    unsigned long long clock;
+    int size, ret;
+
+    if (dev == NULL)
+        return -EBADF;
+    if (dev->nr_members > 0) {                        /* Fan out what acts on the media */
+        ret = stripe_ioctl(dev, cmd, arg);
+        if (ret != -ENOTTY)
+            return ret;
+    }
     switch (cmd)
     {
-    case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
-        memcpy(arg, &disk.layout_size, sizeof(int));
+    case IOC_REQ_DEVICE_SIZE:                         /* Device Size, clamped for old callers */
+        size = dev->layout_size > INT_MAX ? ADDR_ROUND_UP(dev, (long long)INT_MAX) : dev->layout_size;
+        memcpy(arg, &size, sizeof(int));
         break;
+    case IOC_REQ_DEVICE_SIZE64:
+        memcpy(arg, &dev->layout_size, sizeof(long long));
+        break;
+    case IOC_REQ_DEVICE_DISCARD:                      /* Drop a range, no emulated cost */
+        memcpy(&range, arg, sizeof(struct ddriver_range));
+        ret = check_valid_range(dev, range.offset, range.len);
+        if (ret < 0)
+            return ret;
+        trace_record(dev, DDRIVER_TRACE_DISCARD, range.offset, range.len);
+        return emulate_discard(dev, range.offset, range.len);
     case IOC_REQ_DEVICE_STATE:                        /* Device State */
-        state.read_cnt = disk.read_cnt;
-        state.write_cnt = disk.write_cnt;
-        state.seek_cnt = disk.seek_cnt;
+        state.read_cnt = STAT_GET(dev, read_cnt);
+        state.write_cnt = STAT_GET(dev, write_cnt);
+        state.seek_cnt = STAT_GET(dev, seek_cnt);
         memcpy(arg, &state, sizeof(struct ddriver_state));
         break;
-    case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
-        lseek(fd, 0, SEEK_SET);
-        char buf[4096] = {'\0'};
-        for (size_t i = 0; i < CONFIG_DISK_SZ; i += 4096)
-        {
-            write(fd, buf, 4096);
-        }
-        lseek(fd, 0, SEEK_SET);
-        disk.read_cnt = 0;
-        disk.write_cnt = 0;
-        disk.seek_cnt = 0;
-        break;
+    case IOC_REQ_DEVICE_RESET:                        /* Reset Device, drops all blocks */
+        return emulate_reset(dev);
     case IOC_REQ_DEVICE_IO_SZ:
-        memcpy(arg, &disk.iounit_size, sizeof(int));
+        memcpy(arg, &dev->iounit_size, sizeof(int));
+        break;
+    case IOC_REQ_DEVICE_FLUSH:                        /* Persist device content */
+        return dev_flush(dev);
+    case IOC_REQ_DEVICE_CLOCK:                        /* Emulated elapsed time */
+        clock = STAT_GET(dev, elapsed_us);
+        memcpy(arg, &clock, sizeof(unsigned long long));
+        break;
+    case IOC_REQ_DEVICE_PROFILE:                      /* Select latency profile */
+        return set_profile(dev, *(int *)arg);
+    case IOC_REQ_DEVICE_GET_LAT:
+        lat.read_lat  = dev->read_lat;
+        lat.write_lat = dev->write_lat;
+        lat.seek_lat  = dev->seek_lat;
+        lat.track_num = dev->track_num;
+        memcpy(arg, &lat, sizeof(struct ddriver_latency));
+        break;
+    case IOC_REQ_DEVICE_SET_LAT:                      /* Custom latency */
+        return set_latency(dev, (struct ddriver_latency *)arg);
+    case IOC_REQ_DEVICE_SET_DIST:                     /* Latency distribution */
+        return set_dist(dev, (struct ddriver_lat_dist *)arg);
+    case IOC_REQ_DEVICE_LAT_PCTL:                     /* Per-op latency percentiles */
+        pthread_mutex_lock(&dev->lock);
+        hist_report(&dev->hist[DDRIVER_OP_READ], &report.read);
+        hist_report(&dev->hist[DDRIVER_OP_WRITE], &report.write);
+        pthread_mutex_unlock(&dev->lock);
+        memcpy(arg, &report, sizeof(struct ddriver_lat_report));
+        break;
+    case IOC_REQ_DEVICE_SCHED:                        /* Async request scheduler */
+        return set_sched(dev, *(int *)arg);
+    case IOC_REQ_SUBMIT_BATCH:                        /* Same protocol as the kernel ddriver */
+        return submit_batch(dev, (struct ddriver_batch *)arg);
+    case IOC_REQ_DEVICE_STATE_V2:                     /* 64-bit counters and histograms */
+        pthread_mutex_lock(&dev->lock);
+        stats_report(dev, (struct ddriver_stats_v2 *)arg);
+        pthread_mutex_unlock(&dev->lock);
         break;
     default:
         break;
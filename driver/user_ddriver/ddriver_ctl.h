@@ -14,8 +14,107 @@ struct ddriver_state
     int seek_cnt;
 };
 
+#define DDRIVER_PROFILE_HDD     0                   /* 2ms read, 1ms write, 4.17ms per revolution */
+#define DDRIVER_PROFILE_SSD     1                   /* SATA SSD, no positioning cost */
+#define DDRIVER_PROFILE_NVME    2
+#define DDRIVER_PROFILE_ZERO    3                   /* No emulated latency at all */
+
+struct ddriver_latency
+{
+    int read_lat;                                   /* us */
+    int write_lat;                                  /* us */
+    int seek_lat;                                   /* us per revolution, 0 disables seek cost */
+    int track_num;
+};
+
+#define DDRIVER_DIST_FIXED      0
+#define DDRIVER_DIST_LOGNORMAL  1                   /* Median at the profile latency */
+#define DDRIVER_DIST_BIMODAL    2                   /* Profile latency, or a spike */
+
+struct ddriver_lat_dist
+{
+    int type;                                       /* DDRIVER_DIST_* */
+    int sigma_milli;                                /* Lognormal sigma * 1000 */
+    int spike_ppm;                                  /* Chance of a slow op, per million */
+    int spike_mult;                                 /* Slow op latency multiplier */
+};
+
+struct ddriver_lat_pctl
+{
+    unsigned long long count;
+    unsigned int p50;                               /* us */
+    unsigned int p90;
+    unsigned int p99;
+    unsigned int p999;
+    unsigned int max;
+};
+
+struct ddriver_lat_report
+{
+    struct ddriver_lat_pctl read;
+    struct ddriver_lat_pctl write;
+};
+
+#define DDRIVER_SCHED_CLOOK     0                   /* Ascending sweep, wrap to lowest */
+#define DDRIVER_SCHED_NOOP      1                   /* Submission order */
+#define DDRIVER_SCHED_SCAN      2                   /* Elevator, reverses at the ends */
+
+#define DDRIVER_STATS_HIST_SZ   32                  /* Bucket i holds [2^i, 2^(i+1)) us */
+#define DDRIVER_STATS_REGIONS   64                  /* Device split into equal regions */
+
+struct ddriver_stats_v2
+{
+    unsigned long long read_cnt;
+    unsigned long long write_cnt;
+    unsigned long long seek_cnt;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned long long seek_dist;                   /* Total head travel in bytes */
+    unsigned long long elapsed_us;                  /* Total emulated I/O time */
+    unsigned long long lat_hist[2][DDRIVER_STATS_HIST_SZ];      /* [read / write][bucket] */
+    unsigned long long region_cnt[2][DDRIVER_STATS_REGIONS];    /* [read / write][region] */
+    unsigned long long region_sz;                   /* Bytes per region */
+};
+
+struct ddriver_range
+{
+    long long offset;                               /* Aligned to IO unit */
+    long long len;                                  /* Multiple of IO unit */
+};
+
+#define DDRIVER_BATCH_READ      0                   /* Same values as DDRIVER_OP_* */
+#define DDRIVER_BATCH_WRITE     1
+
+struct ddriver_batch_desc
+{
+    int op;                                         /* DDRIVER_BATCH_* */
+    int status;                                     /* Out: bytes transferred, or -errno */
+    long long offset;                               /* Aligned to IO unit */
+    long long len;                                  /* Multiple of IO unit */
+    unsigned long long buf;                         /* User buffer address */
+};
+
+struct ddriver_batch
+{
+    int nr;                                         /* Descriptors at @descs */
+    int done;                                       /* Out: descriptors that succeeded */
+    unsigned long long descs;                       /* Address of struct ddriver_batch_desc[nr] */
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_FLUSH    _IO(IOC_MAGIC, 4)
+#define IOC_REQ_DEVICE_CLOCK    _IOR(IOC_MAGIC, 5, unsigned long long)
+#define IOC_REQ_DEVICE_PROFILE  _IOW(IOC_MAGIC, 6, int)
+#define IOC_REQ_DEVICE_GET_LAT  _IOR(IOC_MAGIC, 7, struct ddriver_latency)
+#define IOC_REQ_DEVICE_SET_LAT  _IOW(IOC_MAGIC, 8, struct ddriver_latency)
+#define IOC_REQ_DEVICE_SET_DIST _IOW(IOC_MAGIC, 9, struct ddriver_lat_dist)
+#define IOC_REQ_DEVICE_LAT_PCTL _IOR(IOC_MAGIC, 10, struct ddriver_lat_report)
+#define IOC_REQ_DEVICE_SCHED    _IOW(IOC_MAGIC, 11, int)
+#define IOC_REQ_DEVICE_STATE_V2 _IOR(IOC_MAGIC, 12, struct ddriver_stats_v2)
+#define IOC_REQ_DEVICE_SIZE64   _IOR(IOC_MAGIC, 13, long long)
+#define IOC_REQ_DEVICE_DISCARD  _IOW(IOC_MAGIC, 14, struct ddriver_range)
+#define IOC_REQ_SUBMIT_BATCH    _IOWR(IOC_MAGIC, 15, struct ddriver_batch)
 #endif
\ No newline at end of file
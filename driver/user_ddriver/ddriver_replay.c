@@ -0,0 +1,145 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include <unistd.h>
+#include <time.h>
+#include "errno.h"
+#include "include/ddriver.h"
+
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define REPLAY_BUF_SZ   (1024 * 1024)                /* Grown for larger requests */
+#define REPLAY_PATTERN  (0x5a)                       /* Written data isn't traced */
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+void usage(const char *prog) {
+    printf("用法: %s [-p] <trace> <image>\n", prog);
+    printf("按DDRIVER_TRACE录制的顺序向<image>重放请求，设备配置取自DDRIVER_*环境变量\n");
+    printf("-p            按录制时的时间间隔发出请求，默认尽快重放\n");
+}
+
+unsigned long long now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void print_pctl(const char *name, const struct ddriver_lat_pctl *pctl) {
+    printf("%-6s count %-10llu p50 %-8u p90 %-8u p99 %-8u p999 %-8u max %u (us)\n",
+           name, pctl->count, pctl->p50, pctl->p90, pctl->p99, pctl->p999, pctl->max);
+}
+/******************************************************************************
+* SECTION: Main
+*******************************************************************************/
+int main(int argc, char **argv) {
+    struct ddriver_trace_hdr hdr;
+    struct ddriver_trace_rec rec;
+    struct ddriver_lat_report report;
+    struct ddriver_range range;
+    unsigned long long start, clock, cnt[4] = {0};
+    char env[32], *buf;
+    size_t buf_sz = REPLAY_BUF_SZ;
+    int opt, paced = 0, fd, ret = 0;
+    FILE *trace;
+
+    while ((opt = getopt(argc, argv, "ph")) != -1) {
+        switch (opt) {
+        case 'p':
+            paced = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    trace = fopen(argv[optind], "r");
+    if (trace == NULL) {
+        printf("can't open trace %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, trace) != 1 || hdr.magic != DDRIVER_TRACE_MAGIC) {
+        printf("%s is not a ddriver trace\n", argv[optind]);
+        fclose(trace);
+        return 1;
+    }
+
+    /* Recorded geometry unless overridden */
+    snprintf(env, sizeof(env), "%lld", hdr.disk_size);
+    setenv("DDRIVER_DISK_SZ", env, 0);
+    snprintf(env, sizeof(env), "%d", hdr.iounit_size);
+    setenv("DDRIVER_IO_SZ", env, 0);
+    unsetenv("DDRIVER_TRACE");                        /* Never trace the replay into itself */
+
+    fd = ddriver_open(argv[optind + 1]);
+    buf = malloc(buf_sz);
+    if (fd < 0 || buf == NULL) {
+        printf("can't open device %s\n", argv[optind + 1]);
+        fclose(trace);
+        return 1;
+    }
+    memset(buf, REPLAY_PATTERN, buf_sz);
+
+    start = now_us();
+    while (ret >= 0 && fread(&rec, sizeof(rec), 1, trace) == 1) {
+        if (paced && now_us() - start < rec.ts_us) {
+            usleep(rec.ts_us - (now_us() - start));
+        }
+        if (rec.size > buf_sz) {
+            free(buf);
+            buf_sz = rec.size;
+            buf = malloc(buf_sz);
+            if (buf == NULL) {
+                ret = -ENOMEM;
+                break;
+            }
+            memset(buf, REPLAY_PATTERN, buf_sz);
+        }
+        switch (rec.op) {
+        case DDRIVER_OP_READ:
+            ret = ddriver_pread(fd, buf, rec.size, rec.offset);
+            break;
+        case DDRIVER_OP_WRITE:
+            ret = ddriver_pwrite(fd, buf, rec.size, rec.offset);
+            break;
+        case DDRIVER_TRACE_SEEK:
+            ret = ddriver_seek(fd, rec.offset, SEEK_SET);
+            break;
+        case DDRIVER_TRACE_DISCARD:
+            range.offset = rec.offset;
+            range.len = rec.size;
+            ret = ddriver_ioctl(fd, IOC_REQ_DEVICE_DISCARD, &range);
+            break;
+        default:
+            printf("unknown op %d in trace\n", rec.op);
+            ret = -EINVAL;
+            continue;
+        }
+        cnt[rec.op]++;
+    }
+    if (ret < 0) {
+        printf("replay stopped at op %d of %u bytes at %lld: %d\n",
+               rec.op, rec.size, rec.offset, ret);
+    }
+
+    printf("replayed %llu reads, %llu writes, %llu seeks, %llu discards in %llu us\n",
+           cnt[DDRIVER_OP_READ], cnt[DDRIVER_OP_WRITE], cnt[DDRIVER_TRACE_SEEK],
+           cnt[DDRIVER_TRACE_DISCARD], now_us() - start);
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_CLOCK, &clock);
+    printf("emulated device time %llu us\n", clock);
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_LAT_PCTL, &report);
+    print_pctl("read", &report.read);
+    print_pctl("write", &report.write);
+
+    free(buf);
+    fclose(trace);
+    ddriver_close(fd);
+    return ret < 0;
+}
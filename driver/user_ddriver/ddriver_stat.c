@@ -0,0 +1,137 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include "errno.h"
+#include "include/ddriver.h"
+
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define STATS_SUFFIX    "_stats"
+#define MB              (1024.0 * 1024.0)
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+struct sample
+{
+    double             time;                         /* s */
+    unsigned long long read_cnt;
+    unsigned long long write_cnt;
+    unsigned long long seek_cnt;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned long long seek_dist;
+    unsigned long long elapsed_us;
+};
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+void usage(const char *prog) {
+    printf("用法: %s [-i 间隔ms] [-n 次数] <image>\n", prog);
+    printf("实时显示打开<image>的进程中ddriver的IOPS、带宽与寻道频率\n");
+}
+
+double now(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void take(const struct ddriver_live_stats *stats, struct sample *s) {
+    s->time        = now();
+    s->read_cnt    = __atomic_load_n(&stats->read_cnt, __ATOMIC_RELAXED);
+    s->write_cnt   = __atomic_load_n(&stats->write_cnt, __ATOMIC_RELAXED);
+    s->seek_cnt    = __atomic_load_n(&stats->seek_cnt, __ATOMIC_RELAXED);
+    s->read_bytes  = __atomic_load_n(&stats->read_bytes, __ATOMIC_RELAXED);
+    s->write_bytes = __atomic_load_n(&stats->write_bytes, __ATOMIC_RELAXED);
+    s->seek_dist   = __atomic_load_n(&stats->seek_dist, __ATOMIC_RELAXED);
+    s->elapsed_us  = __atomic_load_n(&stats->elapsed_us, __ATOMIC_RELAXED);
+}
+
+double delta(unsigned long long cur, unsigned long long prev) {
+    return cur >= prev ? (double)(cur - prev) : 0;    /* Counters reset by the owner */
+}
+/******************************************************************************
+* SECTION: Main
+*******************************************************************************/
+int main(int argc, char **argv) {
+    struct ddriver_live_stats *stats;
+    struct sample prev, cur;
+    char path[4096];
+    int opt, fd, interval = 1000, count = -1, rows = 0, tty = isatty(STDOUT_FILENO);
+    double dt;
+
+    while ((opt = getopt(argc, argv, "i:n:h")) != -1) {
+        switch (opt) {
+        case 'i':
+            interval = atoi(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 1 || interval <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    snprintf(path, sizeof(path), "%s" STATS_SUFFIX, argv[optind]);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("can't open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    stats = mmap(NULL, sizeof(struct ddriver_live_stats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED || stats->magic != DDRIVER_STATS_MAGIC) {
+        printf("%s holds no ddriver stats\n", path);
+        return 1;
+    }
+
+    take(stats, &prev);
+    while (count != 0) {
+        usleep(interval * 1000);
+        take(stats, &cur);
+        dt = cur.time - prev.time;
+        if (tty) {
+            printf("\033[H\033[J");                   /* Redraw in place, like top */
+            printf("ddriver %s  pid %d%s  size %lld  io %d  queues %d\n\n", argv[optind],
+                   stats->pid, stats->pid && kill(stats->pid, 0) == 0 ? "" : " (closed)",
+                   stats->disk_size, stats->iounit_size, stats->nr_queues);
+        }
+        if (tty || rows++ % 20 == 0) {                /* Header every 20 rows, like iostat */
+            printf("%10s %10s %10s %10s %10s %12s %8s\n",
+                   "r/s", "w/s", "rMB/s", "wMB/s", "seek/s", "seekKB/seek", "util%");
+        }
+        printf("%10.0f %10.0f %10.2f %10.2f %10.0f %12.1f %8.1f\n",
+               delta(cur.read_cnt, prev.read_cnt) / dt,
+               delta(cur.write_cnt, prev.write_cnt) / dt,
+               delta(cur.read_bytes, prev.read_bytes) / dt / MB,
+               delta(cur.write_bytes, prev.write_bytes) / dt / MB,
+               delta(cur.seek_cnt, prev.seek_cnt) / dt,
+               cur.seek_cnt > prev.seek_cnt ?
+                   delta(cur.seek_dist, prev.seek_dist) / delta(cur.seek_cnt, prev.seek_cnt) / 1024 : 0,
+               delta(cur.elapsed_us, prev.elapsed_us) / (dt * 1e6) * 100);
+        if (tty) {
+            printf("\ntotal %llu reads (%.1f MB), %llu writes (%.1f MB), %llu seeks, %llu us emulated\n",
+                   cur.read_cnt, cur.read_bytes / MB, cur.write_cnt, cur.write_bytes / MB,
+                   cur.seek_cnt, cur.elapsed_us);
+        }
+        fflush(stdout);
+        prev = cur;
+        if (count > 0)
+            count--;
+    }
+    munmap(stats, sizeof(struct ddriver_live_stats));
+    return 0;
+}
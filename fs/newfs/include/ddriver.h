@@ -3,6 +3,31 @@
 
 #include "ddriver_ctl_user.h"
 #include "stdio.h"
+#include <sys/uio.h>
+
+#define DDRIVER_OP_READ     0
+#define DDRIVER_OP_WRITE    1
+
+/**
+ * @brief 异步提交项
+ */
+struct ddriver_sqe
+{
+    int     op;                                      /* DDRIVER_OP_READ / DDRIVER_OP_WRITE */
+    char   *buf;                                     /* 完成前必须保持有效 */
+    size_t  size;                                    /* 设备IO单位的整数倍 */
+    off_t   offset;                                  /* 和设备IO单位对齐 */
+    void   *user_data;                               /* 原样返回到完成项中 */
+};
+
+/**
+ * @brief 异步完成项
+ */
+struct ddriver_cqe
+{
+    void   *user_data;
+    int     res;                                     /* 传输字节数，小于0失败 */
+};
 
 /**
  * @brief 打开ddriver设备
@@ -42,6 +67,89 @@ int ddriver_write(int fd, char *buf, size_t size);
  */
 int ddriver_read(int fd, char *buf, size_t size);
 
+/**
+ * @brief 连续写入多个IO单位，整段只计一次访问开销
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要写入的数据Buf
+ * @param size 要写入的数据大小，必须是设备IO单位的整数倍
+ * @return int 写入字节数，小于0失败
+ */
+int ddriver_write_blocks(int fd, char *buf, size_t size);
+
+/**
+ * @brief 连续读出多个IO单位，整段只计一次访问开销
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要读出的数据Buf
+ * @param size 要读出的数据大小，必须是设备IO单位的整数倍
+ * @return int 读出字节数，小于0失败
+ */
+int ddriver_read_blocks(int fd, char *buf, size_t size);
+
+/**
+ * @brief 向量写入，从当前读写位置处连续写入各段
+ * 
+ * @param fd ddriver设备handler
+ * @param iov 数据段数组，每段长度必须是设备IO单位的整数倍
+ * @param iovcnt 数据段个数
+ * @return int 写入字节数，小于0失败
+ */
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief 向量读出，从当前读写位置处连续读入各段
+ * 
+ * @param fd ddriver设备handler
+ * @param iov 数据段数组，每段长度必须是设备IO单位的整数倍
+ * @param iovcnt 数据段个数
+ * @return int 读出字节数，小于0失败
+ */
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief 定位写入，无需先调用ddriver_seek，也不移动ddriver_seek设置的读写位置
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要写入的数据Buf
+ * @param size 要写入的数据大小，必须是设备IO单位的整数倍
+ * @param offset 写入位置，注意要和设备IO单位对齐
+ * @return int 写入字节数，小于0失败
+ */
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * @brief 定位读出，无需先调用ddriver_seek，也不移动ddriver_seek设置的读写位置
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要读出的数据Buf
+ * @param size 要读出的数据大小，必须是设备IO单位的整数倍
+ * @param offset 读出位置，注意要和设备IO单位对齐
+ * @return int 读出字节数，小于0失败
+ */
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * @brief 异步提交一批读写请求，模拟延迟由驱动后台线程承担
+ * 
+ * @param fd ddriver设备handler
+ * @param sqes 请求数组
+ * @param nr 请求个数
+ * @return int 实际提交个数，未完成请求过多时可能少于nr，小于0失败
+ */
+int ddriver_submit(int fd, struct ddriver_sqe *sqes, int nr);
+
+/**
+ * @brief 收割已完成的异步请求
+ * 
+ * @param fd ddriver设备handler
+ * @param cqes 完成项数组
+ * @param min_nr 至少等待完成的个数
+ * @param max_nr 最多收割的个数
+ * @return int 收割个数，小于0失败
+ */
+int ddriver_poll_completions(int fd, struct ddriver_cqe *cqes, int min_nr, int max_nr);
+
 /**
  * @brief ddriver IO控制
  * 
@@ -13,9 +13,36 @@ struct ddriver_state
     int seek_cnt;
 };
 
+struct ddriver_range
+{
+    long long offset;                               /* Aligned to IO unit */
+    long long len;                                  /* Multiple of IO unit */
+};
+
+#define DDRIVER_BATCH_READ      0                   /* Same values as DDRIVER_OP_* */
+#define DDRIVER_BATCH_WRITE     1
+
+struct ddriver_batch_desc
+{
+    int op;                                         /* DDRIVER_BATCH_* */
+    int status;                                     /* Out: bytes transferred, or -errno */
+    long long offset;                               /* Aligned to IO unit */
+    long long len;                                  /* Multiple of IO unit */
+    unsigned long long buf;                         /* User buffer address */
+};
+
+struct ddriver_batch
+{
+    int nr;                                         /* Descriptors at @descs */
+    int done;                                       /* Out: descriptors that succeeded */
+    unsigned long long descs;                       /* Address of struct ddriver_batch_desc[nr] */
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)                     /* 请求查看设备大小 */
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)    /* 请求设备状态，返回 ddriver_state */
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)                           /* 请求重置设备 */
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)                     /* 请求设备IO大小 */
+#define IOC_REQ_DEVICE_DISCARD  _IOW(IOC_MAGIC, 14, struct ddriver_range)   /* 请求丢弃一段区间，读回为0 */
+#define IOC_REQ_SUBMIT_BATCH    _IOWR(IOC_MAGIC, 15, struct ddriver_batch)  /* 请求一次提交一批读写 */
 
 #endif
\ No newline at end of file
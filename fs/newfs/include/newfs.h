@@ -31,6 +31,9 @@ char* 			   newfs_get_fname(const char* path);
 int 			   newfs_calc_lvl(const char * path);
 int 			   newfs_driver_read(int offset, uint8_t *out_content, int size);
 int 			   newfs_driver_write(int offset, uint8_t *in_content, int size);
+int 			   newfs_driver_blks(int op, int *bno, uint8_t **contents, int blk_num);
+int 			   newfs_driver_batch(int op, struct ddriver_batch_desc *descs, int nr);
+int 			   newfs_driver_discard(int offset, int size);
 
 
 int 			   newfs_mount(struct custom_options options);
@@ -38,9 +41,11 @@ int 			   newfs_mount();
 
 
 int 			   newfs_alloc_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry);
+int 			   newfs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry);
 struct newfs_dentry* newfs_get_dentry(struct newfs_inode * inode, int dir);
 struct newfs_inode*  newfs_alloc_inode(struct newfs_dentry * dentry);
 int 			   newfs_sync_inode(struct newfs_inode * inode);
+int 			   newfs_drop_inode(struct newfs_inode * inode);
 struct newfs_inode*  newfs_read_inode(struct newfs_dentry * dentry, int ino);
 
 struct newfs_dentry* newfs_lookup(const char * path, boolean * is_find, boolean* is_root);
@@ -28,8 +28,8 @@ static struct fuse_operations operations = {
 	.read = newfs_read,								  	 /* 读文件 */
 	.utimens = newfs_utimens,				 /* 修改时间，忽略，避免touch报错 */
 	.truncate = newfs_truncate,						  		 /* 改变文件大小 */
-	.unlink = NULL,							  		 /* 删除文件 */
-	.rmdir	= NULL,							  		 /* 删除目录， rm -r */
+	.unlink = newfs_unlink,							 /* 删除文件 */
+	.rmdir	= newfs_rmdir,							  		 /* 删除目录， rm -r */
 	.rename = NULL,							  		 /* 重命名，mv */
 
 	.open = NULL,							
@@ -410,8 +410,30 @@ int newfs_read(const char* path, char* buf, size_t size, off_t offset,
  * @return int 0成功，否则失败
  */
 int newfs_unlink(const char* path) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	struct newfs_dentry* parent;
+	int ret;
+
+	if (is_find == FALSE) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	if (is_root == TRUE) {
+		return -NEWFS_ERROR_INVAL;
+	}
+	//目录只能由rmdir删除
+	if (NEWFS_IS_DIR(dentry->inode)) {
+		return -NEWFS_ERROR_ISDIR;
+	}
+
+	parent = dentry->parent;
+	ret = newfs_drop_inode(dentry->inode);			 /* 释放的数据块同时丢弃 */
+	if (ret != NEWFS_ERROR_NONE) {
+		return ret;
+	}
+	newfs_drop_dentry(parent->inode, dentry);
+	free(dentry);
+	return NEWFS_ERROR_NONE;
 }
 
 /**
@@ -427,8 +449,33 @@ int newfs_unlink(const char* path) {
  * @return int 0成功，否则失败
  */
 int newfs_rmdir(const char* path) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	struct newfs_dentry* parent;
+	int ret;
+
+	if (is_find == FALSE) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	if (is_root == TRUE) {
+		return -NEWFS_ERROR_INVAL;
+	}
+	if (!NEWFS_IS_DIR(dentry->inode)) {
+		return -NEWFS_ERROR_NOTDIR;
+	}
+	//子项需先逐个删除，见上方rm -r的步骤
+	if (dentry->inode->dir_cnt > 0) {
+		return -NEWFS_ERROR_NOTEMPTY;
+	}
+
+	parent = dentry->parent;
+	ret = newfs_drop_inode(dentry->inode);
+	if (ret != NEWFS_ERROR_NONE) {
+		return ret;
+	}
+	newfs_drop_dentry(parent->inode, dentry);
+	free(dentry);
+	return NEWFS_ERROR_NONE;
 }
 
 /**
@@ -1,4 +1,8 @@
 #include "../include/newfs.h"
+#include <pthread.h>
+
+//设备只有一个完成队列，FUSE多线程挂载时提交与收割须成对独占
+static pthread_mutex_t newfs_ring_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * @brief 获取文件名
@@ -46,15 +50,11 @@ int newfs_driver_read(int offset, uint8_t *out_content, int size) {
     int      bias           = offset - offset_aligned;
     int      size_aligned   = NEWFS_ROUND_UP((size + bias), NEWFS_BLK_SZ());
     uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
 
-    ddriver_seek(NEWFS_DRIVER(), offset_aligned, SEEK_SET);
-    //读写磁盘时需要按照磁盘块大小(512B)去读
-    while (size_aligned != 0)
-    {
-        ddriver_read(NEWFS_DRIVER(), cur, NEWFS_IO_SZ());
-        cur          += NEWFS_IO_SZ();
-        size_aligned -= NEWFS_IO_SZ();   
+    //整段对齐区域一次定位读入，只付一次磁盘访问开销
+    if (ddriver_pread(NEWFS_DRIVER(), (char *)temp_content, size_aligned, offset_aligned) < 0) {
+        free(temp_content);
+        return -NEWFS_ERROR_IO;
     }
     memcpy(out_content, temp_content + bias, size);
     free(temp_content);
@@ -74,22 +74,103 @@ int newfs_driver_write(int offset, uint8_t *in_content, int size) {
     int      bias           = offset - offset_aligned;
     int      size_aligned   = NEWFS_ROUND_UP((size + bias), NEWFS_BLK_SZ());
     uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
-    newfs_driver_read(offset_aligned, temp_content, size_aligned);
+    if (newfs_driver_read(offset_aligned, temp_content, size_aligned) != NEWFS_ERROR_NONE) {
+        free(temp_content);
+        return -NEWFS_ERROR_IO;
+    }
     memcpy(temp_content + bias, in_content, size);
     
-    ddriver_seek(NEWFS_DRIVER(), offset_aligned, SEEK_SET);
-    //读写磁盘时需要按照磁盘块大小(512B)去写
-    while (size_aligned != 0)
-    {
-        ddriver_write(NEWFS_DRIVER(), cur, NEWFS_IO_SZ());
-        cur          += NEWFS_IO_SZ();
-        size_aligned -= NEWFS_IO_SZ();   
+    //整段对齐区域一次定位写回，只付一次磁盘访问开销
+    if (ddriver_pwrite(NEWFS_DRIVER(), (char *)temp_content, size_aligned, offset_aligned) < 0) {
+        free(temp_content);
+        return -NEWFS_ERROR_IO;
     }
 
     free(temp_content);
     return NEWFS_ERROR_NONE;
 }
+/**
+ * @brief 批量读写整数据块，一次提交全部请求后统一等待完成
+ * 
+ * @param op DDRIVER_OP_READ或DDRIVER_OP_WRITE
+ * @param bno 数据块号数组
+ * @param contents 每个数据块对应的缓冲区，大小为一个数据块
+ * @param blk_num 数据块个数，不超过NEWFS_DATA_PER_FILE
+ * @return int 
+ */
+int newfs_driver_blks(int op, int *bno, uint8_t **contents, int blk_num) {
+    struct ddriver_sqe sqes[NEWFS_DATA_PER_FILE];
+    struct ddriver_cqe cqes[NEWFS_DATA_PER_FILE];
+    int ret = NEWFS_ERROR_NONE;
+    int submitted, done;
+    int blk_cnt;
+
+    for (blk_cnt = 0; blk_cnt < blk_num; blk_cnt++) {
+        sqes[blk_cnt].op        = op;
+        sqes[blk_cnt].buf       = (char *)contents[blk_cnt];
+        sqes[blk_cnt].size      = NEWFS_BLK_SZ();
+        sqes[blk_cnt].offset    = NEWFS_DATA_OFS(bno[blk_cnt]);
+        sqes[blk_cnt].user_data = contents[blk_cnt];
+    }
+    //全部数据块一起提交，驱动侧并发执行，这里只等待一次
+    //持锁期间完成队列里只有本次的请求，收割到的全是自己的
+    pthread_mutex_lock(&newfs_ring_lock);
+    submitted = ddriver_submit(NEWFS_DRIVER(), sqes, blk_num);
+    if (submitted < 0) {
+        pthread_mutex_unlock(&newfs_ring_lock);
+        return -NEWFS_ERROR_IO;
+    }
+    done = ddriver_poll_completions(NEWFS_DRIVER(), cqes, submitted, blk_num);
+    pthread_mutex_unlock(&newfs_ring_lock);
+    if (done != submitted || submitted != blk_num) {
+        ret = -NEWFS_ERROR_IO;
+    }
+    for (blk_cnt = 0; blk_cnt < done; blk_cnt++) {
+        if (cqes[blk_cnt].res < 0) {
+            ret = -NEWFS_ERROR_IO;
+        }
+    }
+    return ret;
+}
+/**
+ * @brief 一次IOC_REQ_SUBMIT_BATCH提交多段读写，驱动按顺序执行
+ * 
+ * @param op DDRIVER_BATCH_READ或DDRIVER_BATCH_WRITE，覆盖每段原有的op
+ * @param descs 每段的offset按IO大小对齐，len为IO大小的整数倍
+ * @param nr 段数
+ * @return int 
+ */
+int newfs_driver_batch(int op, struct ddriver_batch_desc *descs, int nr) {
+    struct ddriver_batch batch;
+    int desc_cnt;
+
+    for (desc_cnt = 0; desc_cnt < nr; desc_cnt++) {
+        descs[desc_cnt].op = op;
+    }
+    batch.nr    = nr;
+    batch.done  = 0;
+    batch.descs = (unsigned long long)(uintptr_t)descs;
+    if (ddriver_ioctl(NEWFS_DRIVER(), IOC_REQ_SUBMIT_BATCH, &batch) < 0 || batch.done != nr) {
+        return -NEWFS_ERROR_IO;
+    }
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 驱动丢弃，区间内的块不再占用磁盘空间，读回为0
+ * 
+ * @param offset 按IO大小对齐
+ * @param size 必须是IO大小的整数倍
+ * @return int 
+ */
+int newfs_driver_discard(int offset, int size) {
+    struct ddriver_range range;
+    range.offset = offset;
+    range.len    = size;
+    if (ddriver_ioctl(NEWFS_DRIVER(), IOC_REQ_DEVICE_DISCARD, &range) < 0) {
+        return -NEWFS_ERROR_IO;
+    }
+    return NEWFS_ERROR_NONE;
+}
 /**
  * @brief 为一个inode分配dentry，采用头插法
  * 
@@ -108,6 +189,38 @@ int newfs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
     inode->dir_cnt++;
     return inode->dir_cnt;
 }
+/**
+ * @brief 将dentry从inode的目录项中摘除
+ * 
+ * @param inode 
+ * @param dentry 
+ * @return int 剩余目录项个数
+ */
+int newfs_drop_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    boolean is_find = FALSE;
+    struct newfs_dentry* dentry_cursor = inode->dentrys;
+
+    if (dentry_cursor == dentry) {
+        inode->dentrys = dentry->brother;
+        is_find = TRUE;
+    }
+    else {
+        while (dentry_cursor)
+        {
+            if (dentry_cursor->brother == dentry) {
+                dentry_cursor->brother = dentry->brother;
+                is_find = TRUE;
+                break;
+            }
+            dentry_cursor = dentry_cursor->brother;
+        }
+    }
+    if (!is_find) {
+        return -NEWFS_ERROR_NOTFOUND;
+    }
+    inode->dir_cnt--;
+    return inode->dir_cnt;
+}
 /**
  * @brief 分配一个inode，占用位图
  * 
@@ -198,6 +311,65 @@ struct newfs_inode* newfs_alloc_inode(struct newfs_dentry * dentry) {
 
     return inode;
 }
+/**
+ * @brief 释放inode及其下方结构，归还位图并丢弃数据块
+ *  1) Step 1. 目录则递归释放子项
+ *  2) Step 2. 清除inode位图与data位图
+ *  3) Step 3. 文件则通知设备丢弃数据块
+ *  4) Step 4. 释放内存inode，dentry由调用者释放
+ * 
+ * @param inode 
+ * @return int 
+ */
+int newfs_drop_inode(struct newfs_inode * inode) {
+    struct newfs_dentry* dentry_cursor;
+    struct newfs_dentry* dentry_to_free;
+    int blk_cnt = 0;
+    int bno;
+
+    if (inode == newfs_super.root_dentry->inode) {
+        return -NEWFS_ERROR_INVAL;
+    }
+
+    if (NEWFS_IS_DIR(inode)) {
+        dentry_cursor = inode->dentrys;
+        //递归向下drop，未读入的子inode先读入以获得其数据块号
+        while (dentry_cursor)
+        {
+            if (dentry_cursor->inode == NULL) {
+                dentry_cursor->inode = newfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            }
+            if (dentry_cursor->inode != NULL) {
+                newfs_drop_inode(dentry_cursor->inode);
+            }
+            dentry_to_free = dentry_cursor;
+            dentry_cursor = dentry_cursor->brother;
+            free(dentry_to_free);
+        }
+        inode->dentrys = NULL;
+        inode->dir_cnt = 0;
+    }
+
+    newfs_super.map_inode[inode->ino / UINT8_BITS] &= (uint8_t)(~(0x1 << (inode->ino % UINT8_BITS)));
+    for (blk_cnt = 0; blk_cnt < NEWFS_DATA_PER_FILE; blk_cnt++) {
+        bno = inode->bno[blk_cnt];
+        newfs_super.map_data[bno / UINT8_BITS] &= (uint8_t)(~(0x1 << (bno % UINT8_BITS)));
+        //只有文件内容写在NEWFS_DATA_OFS(bno)处；目录项由newfs_sync_inode
+        //写在NEWFS_INO_OFS(bno)处，在此丢弃会清掉从未使用的范围
+        if (NEWFS_IS_REG(inode)) {
+            newfs_driver_discard(NEWFS_DATA_OFS(bno), NEWFS_BLK_SZ());
+        }
+    }
+
+    if (NEWFS_IS_REG(inode)) {
+        for (blk_cnt = 0; blk_cnt < NEWFS_DATA_PER_FILE; blk_cnt++) {
+            free(inode->block_pointer[blk_cnt]);
+        }
+    }
+    inode->dentry->inode = NULL;
+    free(inode);
+    return NEWFS_ERROR_NONE;
+}
 /**
  * @brief 将内存inode及其下方结构全部刷回磁盘
  * 
@@ -216,6 +388,12 @@ int newfs_sync_inode(struct newfs_inode * inode) {
     inode_d.dir_cnt     = inode->dir_cnt;
     int offset = 0;
     int blk_cnt = 0;  
+    struct ddriver_batch_desc descs[NEWFS_DATA_PER_FILE];
+    struct newfs_dentry*  dentry_first[NEWFS_DATA_PER_FILE];
+    int dentry_cnt[NEWFS_DATA_PER_FILE];
+    int desc_num = 0;
+    int desc_cnt = 0;
+    int ret = NEWFS_ERROR_NONE;
 
     for(blk_cnt = 0; blk_cnt < NEWFS_DATA_PER_FILE; blk_cnt++){
         inode_d.bno[blk_cnt] = inode->bno[blk_cnt];
@@ -234,40 +412,73 @@ int newfs_sync_inode(struct newfs_inode * inode) {
     //因此在刷回inode时需要依次将每个bno中的一堆dentry刷回
     if (NEWFS_IS_DIR(inode)) {   
         blk_cnt = 0;            
+        desc_num = 0;
         dentry_cursor = inode->dentrys;
         while(dentry_cursor != NULL && blk_cnt < NEWFS_DATA_PER_FILE){
             offset = NEWFS_INO_OFS(inode->bno[blk_cnt]);
+            dentry_first[desc_num] = dentry_cursor;
+            dentry_cnt[desc_num] = 0;
             //深搜遍历
             //当前块内最后一个dentry的兄弟指针指向的可能是下一个块内的dentry
             //当前块写完或写满时都要结束写
             while (dentry_cursor != NULL && offset < NEWFS_INO_OFS(inode->bno[blk_cnt] + 1))
             {
+                dentry_cnt[desc_num]++;
+                dentry_cursor = dentry_cursor->brother;
+                offset += sizeof(struct newfs_dentry_d);
+            }
+            //每块要改写的区间先整体读入，改完后整体写回
+            if (dentry_cnt[desc_num] > 0) {
+                descs[desc_num].offset = NEWFS_INO_OFS(inode->bno[blk_cnt]);
+                descs[desc_num].len    = NEWFS_ROUND_UP(dentry_cnt[desc_num] * 
+                                         sizeof(struct newfs_dentry_d), NEWFS_BLK_SZ());
+                descs[desc_num].buf    = (unsigned long long)(uintptr_t)
+                                         malloc(descs[desc_num].len);
+                desc_num++;
+            }
+            blk_cnt++;
+        }
+        //所有目录块一次批量读入、一次批量写回，不再逐个目录项读改写
+        ret = newfs_driver_batch(DDRIVER_BATCH_READ, descs, desc_num);
+        for (desc_cnt = 0; desc_cnt < desc_num && ret == NEWFS_ERROR_NONE; desc_cnt++) {
+            dentry_cursor = dentry_first[desc_cnt];
+            for (blk_cnt = 0; blk_cnt < dentry_cnt[desc_cnt]; blk_cnt++) {
                 memcpy(dentry_d.fname, dentry_cursor->fname, NEWFS_MAX_FILE_NAME);
                 dentry_d.ftype = dentry_cursor->ftype;
                 dentry_d.ino = dentry_cursor->ino;
-                if (newfs_driver_write(offset, (uint8_t *)&dentry_d, 
-                                     sizeof(struct newfs_dentry_d)) != NEWFS_ERROR_NONE) {
-                    NEWFS_DBG("[%s] io error\n", __func__);
-                    return -NEWFS_ERROR_IO;                     
-                }
-            
+                memcpy((uint8_t *)(uintptr_t)descs[desc_cnt].buf + 
+                       blk_cnt * sizeof(struct newfs_dentry_d), 
+                       (uint8_t *)&dentry_d, sizeof(struct newfs_dentry_d));
+                dentry_cursor = dentry_cursor->brother;
+            }
+        }
+        if (ret == NEWFS_ERROR_NONE) {
+            ret = newfs_driver_batch(DDRIVER_BATCH_WRITE, descs, desc_num);
+        }
+        for (desc_cnt = 0; desc_cnt < desc_num; desc_cnt++) {
+            free((void *)(uintptr_t)descs[desc_cnt].buf);
+        }
+        if (ret != NEWFS_ERROR_NONE) {
+            NEWFS_DBG("[%s] io error\n", __func__);
+            return -NEWFS_ERROR_IO;                     
+        }
+        //目录项写回后再依次刷回已载入的子inode
+        for (desc_cnt = 0; desc_cnt < desc_num; desc_cnt++) {
+            dentry_cursor = dentry_first[desc_cnt];
+            for (blk_cnt = 0; blk_cnt < dentry_cnt[desc_cnt]; blk_cnt++) {
                 if (dentry_cursor->inode != NULL) {
                     newfs_sync_inode(dentry_cursor->inode);
                 }
-
                 dentry_cursor = dentry_cursor->brother;
-                offset += sizeof(struct newfs_dentry_d);
             }
-            blk_cnt++;
         }
     }
     else if (NEWFS_IS_REG(inode)) {
-        for(blk_cnt = 0; blk_cnt < NEWFS_DATA_PER_FILE; blk_cnt++){
-            if (newfs_driver_write(NEWFS_DATA_OFS(inode->bno[blk_cnt]), inode->block_pointer[blk_cnt], 
-                             NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
-                NEWFS_DBG("[%s] io error\n", __func__);
-                return -NEWFS_ERROR_IO;
-            }
+        //数据块整块写回，无需先读再写
+        if (newfs_driver_blks(DDRIVER_OP_WRITE, inode->bno, inode->block_pointer, 
+                              NEWFS_DATA_PER_FILE) != NEWFS_ERROR_NONE) {
+            NEWFS_DBG("[%s] io error\n", __func__);
+            return -NEWFS_ERROR_IO;
         }
     }
     return NEWFS_ERROR_NONE;
@@ -330,11 +541,12 @@ struct newfs_inode* newfs_read_inode(struct newfs_dentry * dentry, int ino) {
     else if (NEWFS_IS_REG(inode)) {
         for(blk_cnt = 0; blk_cnt < NEWFS_DATA_PER_FILE; blk_cnt++){
             inode->block_pointer[blk_cnt] = (uint8_t *)malloc(NEWFS_BLK_SZ());
-            if (newfs_driver_read(NEWFS_DATA_OFS(inode->bno[blk_cnt]), inode->block_pointer[blk_cnt], 
-                            NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
-                NEWFS_DBG("[%s] io error\n", __func__);
-                return NULL;                    
-            }
+        }
+        //所有数据块一起提交读取
+        if (newfs_driver_blks(DDRIVER_OP_READ, inode->bno, inode->block_pointer, 
+                              NEWFS_DATA_PER_FILE) != NEWFS_ERROR_NONE) {
+            NEWFS_DBG("[%s] io error\n", __func__);
+            return NULL;                    
         }
     }
     return inode;
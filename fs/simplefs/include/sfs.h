@@ -25,6 +25,7 @@ char* 			   sfs_get_fname(const char* path);
 int 			   sfs_calc_lvl(const char * path);
 int 			   sfs_driver_read(int offset, uint8_t *out_content, int size);
 int 			   sfs_driver_write(int offset, uint8_t *in_content, int size);
+int 			   sfs_driver_discard(int offset, int size);
 
 
 int 			   sfs_mount(struct custom_options options);
@@ -94,6 +94,22 @@ int sfs_driver_write(int offset, uint8_t *in_content, int size) {
     free(temp_content);
     return SFS_ERROR_NONE;
 }
+/**
+ * @brief 驱动丢弃，区间内的块不再占用磁盘空间，读回为0
+ * 
+ * @param offset 按IO大小对齐
+ * @param size 必须是IO大小的整数倍
+ * @return int 
+ */
+int sfs_driver_discard(int offset, int size) {
+    struct ddriver_range range;
+    range.offset = offset;
+    range.len    = size;
+    if (ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_DISCARD, &range) < 0) {
+        return -SFS_ERROR_IO;
+    }
+    return SFS_ERROR_NONE;
+}
 /**
  * @brief 为一个inode分配dentry，采用头插法
  * 
@@ -263,9 +279,10 @@ int sfs_sync_inode(struct sfs_inode * inode) {
  *                      Inode  (Reg File)
  * 
  *  1) Step 1. Erase Bitmap     
- *  2) Step 2. Free Inode                      (Function of sfs_drop_inode)
+ *  2) Step 2. Discard Data Blocks
+ *  3) Step 3. Free Inode                      (Function of sfs_drop_inode)
  * ------------------------------------------------------------------------
- *  3) *Setp 3. Free Dentry belonging to Inode (Outsider)
+ *  4) *Setp 4. Free Dentry belonging to Inode (Outsider)
  * ========================================================================
  * Case 2: Dir
  *                  Inode
@@ -323,6 +340,8 @@ int sfs_drop_inode(struct sfs_inode * inode) {
                 break;
             }
         }
+                                                      /* 数据块已释放，通知设备回收 */
+        sfs_driver_discard(SFS_DATA_OFS(inode->ino), SFS_BLKS_SZ(SFS_DATA_PER_FILE));
         if (inode->data)
             free(inode->data);
         free(inode);
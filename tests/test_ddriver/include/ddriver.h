@@ -3,12 +3,97 @@
 
 #include "ddriver_ctl_user.h"
 #include "stdio.h"
+#include <sys/uio.h>
+
+#define DDRIVER_OP_READ     0
+#define DDRIVER_OP_WRITE    1
+
+#define DDRIVER_FLAG_MMAP   0x1                      /* Map the image, enables ddriver_map_block */
+#define DDRIVER_FLAG_VCLOCK 0x2                      /* Account latency on a virtual clock, never sleep */
+#define DDRIVER_FLAG_DIRECT 0x4                      /* Bypass the host page cache with O_DIRECT */
+
+#define DDRIVER_TRACE_MAGIC   0x52544444             /* "DDTR" */
+#define DDRIVER_STATS_MAGIC   0x54534444             /* "DDST" */
+#define DDRIVER_TRACE_SEEK    2                      /* Trace ops besides DDRIVER_OP_* */
+#define DDRIVER_TRACE_DISCARD 3
+
+struct ddriver_config
+{
+    int     flags;                                   /* DDRIVER_FLAG_* */
+    int     profile;                                 /* DDRIVER_PROFILE_*, HDD by default */
+    struct ddriver_lat_dist dist;                    /* Fixed latency by default */
+    unsigned long long seed;                         /* Latency sampling seed, 0 for default */
+    int     sched;                                   /* DDRIVER_SCHED_*, C-LOOK by default */
+    long long disk_size;                             /* Bytes, 4MB by default, image created sparse */
+    int     iounit_size;                             /* Power of 2 from 512 to 64KB, 512 by default */
+    char   *base;                                    /* Read-only base, the image becomes its overlay */
+    char   *trace;                                   /* Binary trace of every request, off if NULL */
+    int     nr_queues;                               /* Independent hardware queues, 0 for one disk head */
+};
+
+struct ddriver_sqe
+{
+    int     op;                                      /* DDRIVER_OP_* */
+    char   *buf;
+    size_t  size;                                    /* Multiple of IO unit */
+    off_t   offset;                                  /* Aligned to IO unit */
+    void   *user_data;                               /* Returned in the completion */
+};
+
+struct ddriver_cqe
+{
+    void   *user_data;
+    int     res;                                     /* Bytes transferred, or < 0 on error */
+};
+
+struct ddriver_trace_hdr                             /* Starts a trace, records follow */
+{
+    unsigned int magic;                              /* DDRIVER_TRACE_MAGIC */
+    int     iounit_size;
+    long long disk_size;
+};
+
+struct ddriver_live_stats                           /* <image>_stats, updated lock-free while open */
+{
+    unsigned int magic;                              /* DDRIVER_STATS_MAGIC */
+    int     pid;                                     /* Owner, 0 once closed */
+    long long disk_size;
+    int     iounit_size;
+    int     nr_queues;
+    unsigned long long read_cnt;
+    unsigned long long write_cnt;
+    unsigned long long seek_cnt;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned long long seek_dist;                    /* Bytes of head travel */
+    unsigned long long elapsed_us;                   /* Emulated time spent on I/O */
+    unsigned long long region_cnt[2][DDRIVER_STATS_REGIONS];
+};
+
+struct ddriver_trace_rec
+{
+    unsigned long long ts_us;                        /* Since the device was opened */
+    long long offset;
+    unsigned int size;                               /* 0 for seeks */
+    int     op;                                      /* DDRIVER_OP_* or DDRIVER_TRACE_* */
+};
 
 int ddriver_open(char *path);
+int ddriver_open_config(char *path, struct ddriver_config *config);
+int ddriver_open_stripe(char **paths, int nr, int stripe_sz, struct ddriver_config *config);
 int ddriver_seek(int fd, off_t offset, int whence);
 int ddriver_write(int fd, char *buf, size_t size);
 int ddriver_read(int fd, char *buf, size_t size);
+int ddriver_write_blocks(int fd, char *buf, size_t size);
+int ddriver_read_blocks(int fd, char *buf, size_t size);
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt);
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt);
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset);
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset);
+int ddriver_submit(int fd, struct ddriver_sqe *sqes, int nr);
+int ddriver_poll_completions(int fd, struct ddriver_cqe *cqes, int min_nr, int max_nr);
+char* ddriver_map_block(int fd, int blkno);
 int ddriver_ioctl(int fd, unsigned long cmd, void *ret);
 int ddriver_close(int fd);
 
-#endif /* _DDRIVER_H_ */
\ No newline at end of file
+#endif /* _DDRIVER_H_ */
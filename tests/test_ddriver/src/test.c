@@ -1,5 +1,6 @@
 #include "../include/ddriver.h"
 #include <linux/fs.h>
+#include <string.h>
 
 int main(int argc, char const *argv[])
 {
@@ -42,6 +43,182 @@ int main(int argc, char const *argv[])
     printf("write_cnt: %d\n", state.write_cnt);
     printf("seek_cnt: %d\n", state.seek_cnt);
 
+    /* Cycle 5: multi-block read/write test */
+    char mbuffer[2048];
+    char mrbuffer[2048];
+    memset(mbuffer, 'b', sizeof(mbuffer));
+    ddriver_seek(fd, 0, SEEK_SET);
+    if (ddriver_write_blocks(fd, mbuffer, sizeof(mbuffer)) != sizeof(mbuffer)) {
+        return -1;
+    }
+    struct iovec iov[2] = {
+        { .iov_base = mrbuffer,        .iov_len = 512  },
+        { .iov_base = mrbuffer + 512,  .iov_len = 1536 }
+    };
+    ddriver_seek(fd, 0, SEEK_SET);
+    if (ddriver_readv(fd, iov, 2) != sizeof(mrbuffer) 
+        || memcmp(mbuffer, mrbuffer, sizeof(mbuffer)) != 0) {
+        return -1;
+    }
+
+    /* Cycle 6: positional read/write test */
+    memset(mbuffer, 'c', sizeof(mbuffer));
+    if (ddriver_pwrite(fd, mbuffer, sizeof(mbuffer), 4096) != sizeof(mbuffer)
+        || ddriver_pread(fd, mrbuffer, sizeof(mrbuffer), 4096) != sizeof(mrbuffer)
+        || memcmp(mbuffer, mrbuffer, sizeof(mbuffer)) != 0) {
+        return -1;
+    }
+
+    /* Cycle 7: async submit/poll test */
+    struct ddriver_sqe sqes[2] = {
+        { .op = DDRIVER_OP_READ, .buf = mrbuffer,        .size = 1024, .offset = 4096 },
+        { .op = DDRIVER_OP_READ, .buf = mrbuffer + 1024, .size = 1024, .offset = 5120 }
+    };
+    struct ddriver_cqe cqes[2];
+    memset(mrbuffer, 0, sizeof(mrbuffer));
+    if (ddriver_submit(fd, sqes, 2) != 2
+        || ddriver_poll_completions(fd, cqes, 2, 2) != 2
+        || cqes[0].res != 1024 || cqes[1].res != 1024
+        || memcmp(mbuffer, mrbuffer, sizeof(mbuffer)) != 0) {
+        return -1;
+    }
+
+    /* Cycle 8: reset test - written blocks read back as zero */
+    char zbuffer[2048] = {0};
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_RESET, &size);
+    if (ddriver_pread(fd, mrbuffer, sizeof(mrbuffer), 4096) != sizeof(mrbuffer)
+        || memcmp(zbuffer, mrbuffer, sizeof(mrbuffer)) != 0) {
+        return -1;
+    }
+
+    /* Cycle 9: discard test - discarded range reads back as zero */
+    struct ddriver_range range = { .offset = 4096, .len = 1024 };
+    if (ddriver_pwrite(fd, mbuffer, sizeof(mbuffer), 4096) != sizeof(mbuffer)
+        || ddriver_ioctl(fd, IOC_REQ_DEVICE_DISCARD, &range) != 0
+        || ddriver_pread(fd, mrbuffer, sizeof(mrbuffer), 4096) != sizeof(mrbuffer)
+        || memcmp(zbuffer, mrbuffer, 1024) != 0
+        || memcmp(mbuffer + 1024, mrbuffer + 1024, 1024) != 0) {
+        return -1;
+    }
+
+    /* Cycle 10: hole read test - served at no cost but still counted */
+    struct ddriver_stats_v2 stats;
+    unsigned long long clock;
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_RESET, &size);
+    memset(mrbuffer, 'x', sizeof(mrbuffer));
+    if (ddriver_pread(fd, mrbuffer, sizeof(mrbuffer), 8192) != sizeof(mrbuffer)
+        || memcmp(zbuffer, mrbuffer, sizeof(mrbuffer)) != 0) {
+        return -1;
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE, &state);
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE_V2, &stats);
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_CLOCK, &clock);
+    if (state.read_cnt != 1 || stats.read_bytes != sizeof(mrbuffer) 
+        || stats.region_cnt[DDRIVER_OP_READ][8192 / stats.region_sz] != 1 || clock != 0) {
+        return -1;
+    }
+
+    /* Cycle 11: batch test - every descriptor gets its own status */
+    memset(mbuffer, 'g', 1024);
+    struct ddriver_batch_desc descs[4] = {
+        { .op = DDRIVER_BATCH_WRITE, .offset = 0, .len = 1024, .buf = (unsigned long)mbuffer  },
+        { .op = DDRIVER_BATCH_WRITE, .offset = 0, .len = 100,  .buf = (unsigned long)mbuffer  },
+        { .op = DDRIVER_BATCH_READ,  .offset = 0, .len = 1024, .buf = (unsigned long)mrbuffer },
+        { .op = 7,                   .offset = 0, .len = 1024, .buf = (unsigned long)mrbuffer }
+    };
+    struct ddriver_batch batch = { .nr = 4, .descs = (unsigned long)descs };
+    if (ddriver_ioctl(fd, IOC_REQ_SUBMIT_BATCH, &batch) != 0 || batch.done != 2
+        || descs[0].status != 1024 || descs[1].status >= 0
+        || descs[2].status != 1024 || descs[3].status >= 0
+        || memcmp(mbuffer, mrbuffer, 1024) != 0) {
+        return -1;
+    }
+
+    /* Cycle 12: cursor test - positional I/O leaves the read position alone */
+    ddriver_seek(fd, 0, SEEK_SET);
+    if (ddriver_pread(fd, mrbuffer + 1024, 512, 8192) != 512
+        || ddriver_read(fd, mrbuffer, 512) != 512
+        || memcmp(mbuffer, mrbuffer, 512) != 0) {
+        return -1;
+    }
+
+    /* Cycle 13: async range test - an out-of-range neighbour fails alone */
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_SIZE, &size);
+    struct ddriver_sqe edge[2] = {
+        { .op = DDRIVER_OP_READ, .buf = mrbuffer,        .size = 1024, .offset = size - 1024, .user_data = mrbuffer },
+        { .op = DDRIVER_OP_READ, .buf = mrbuffer + 1024, .size = 1024, .offset = size,        .user_data = NULL }
+    };
+    if (ddriver_submit(fd, edge, 2) != 2
+        || ddriver_poll_completions(fd, cqes, 2, 2) != 2
+        || (cqes[0].user_data == mrbuffer ? cqes[0].res : cqes[1].res) != 1024
+        || (cqes[0].user_data == mrbuffer ? cqes[1].res : cqes[0].res) >= 0) {
+        return -1;
+    }
+
+    ddriver_close(fd);
+
+    /* Cycle 14: stripe test - round trip across members */
+    char stripe0[] = "/home/students/200110403/ddriver_stripe0";
+    char stripe1[] = "/home/students/200110403/ddriver_stripe1";
+    char *stripes[2] = { stripe0, stripe1 };
+    memset(mbuffer, 'd', sizeof(mbuffer));
+    fd = ddriver_open_stripe(stripes, 2, 1024, NULL);
+    if (fd < 0
+        || ddriver_pwrite(fd, mbuffer, sizeof(mbuffer), 512) != sizeof(mbuffer)
+        || ddriver_pread(fd, mrbuffer, sizeof(mrbuffer), 512) != sizeof(mrbuffer)
+        || memcmp(mbuffer, mrbuffer, sizeof(mbuffer)) != 0) {
+        return -1;
+    }
+    ddriver_close(fd);
+    fd = ddriver_open(stripe1);                       /* Second stripe unit lands on member 1 */
+    memset(mrbuffer, 0, sizeof(mrbuffer));
+    if (fd < 0 || ddriver_pread(fd, mrbuffer, 1024, 0) != 1024
+        || memcmp(mbuffer, mrbuffer, 1024) != 0) {
+        return -1;
+    }
+    ddriver_close(fd);
+
+    /* Cycle 15: overlay test - writes shadow the base until reset */
+    char base[] = "/home/students/200110403/ddriver_base";
+    char overlay[] = "/home/students/200110403/ddriver_overlay";
+    struct ddriver_config config = { .base = base };
+    memset(mbuffer, 'e', 1024);
+    memset(mbuffer + 1024, 'f', 1024);
+    fd = ddriver_open(base);
+    if (fd < 0 || ddriver_pwrite(fd, mbuffer, 1024, 0) != 1024) {
+        return -1;
+    }
+    ddriver_close(fd);
+    fd = ddriver_open_config(overlay, &config);
+    if (fd < 0 || ddriver_pwrite(fd, mbuffer + 1024, 512, 0) != 512
+        || ddriver_pread(fd, mrbuffer, 1024, 0) != 1024
+        || memcmp(mbuffer + 1024, mrbuffer, 512) != 0
+        || memcmp(mbuffer + 512, mrbuffer + 512, 512) != 0) {
+        return -1;
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_RESET, &size);
+    if (ddriver_pread(fd, mrbuffer, 1024, 0) != 1024
+        || memcmp(mbuffer, mrbuffer, 1024) != 0) {
+        return -1;
+    }
+    ddriver_close(fd);
+
+    /* Cycle 16: shared image test - writes through one handle seen by another */
+    char shared[] = "/home/students/200110403/ddriver_shared";
+    int fd2;
+    fd = ddriver_open(shared);
+    fd2 = ddriver_open(shared);
+    if (fd < 0 || fd2 < 0) {
+        return -1;
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_RESET, &size);   /* Both see a hole at 16384 */
+    memset(mbuffer, 'A', 512);
+    if (ddriver_pwrite(fd2, mbuffer, 512, 16384) != 512
+        || ddriver_pread(fd, mrbuffer, 512, 16384) != 512
+        || memcmp(mbuffer, mrbuffer, 512) != 0) {
+        return -1;
+    }
+    ddriver_close(fd2);
     ddriver_close(fd);
 
     printf("Test Pass :)\n");